@@ -315,5 +315,43 @@ int floatIsEqual(unsigned uf, unsigned ug) {
  *   Rating: 4
  */
 unsigned floatInt2Float(int x) {
-  return 2;
+  /* normalizes the leading 1 to bit 31 by binary search, counting the shift as it
+     goes, and rounds with arithmetic: no loops, and no branch on anything but the sign */
+  unsigned m = x;         //|x|, unsigned so that Tmin has one
+  unsigned base = 157;    //127 + 31, less the 1 that the leading bit adds back below
+  unsigned z;
+  unsigned t;
+  unsigned f;
+  int up;
+
+  if(!x) {
+    return 0;
+  }
+  if(x < 0) {
+    m = -m;
+    base = 413;           //157 + 256: bit 8 of the exponent lands on the sign bit
+  }
+
+  t = (m < 0x10000) << 4; //z counts the leading 0s, shifted out 16, 8, 4, 2 and then 1 at a time
+  m = m << t;
+  z = t;
+  t = (m < 0x1000000) << 3;
+  m = m << t;
+  z = z + t;
+  t = (m < 0x10000000) << 2;
+  m = m << t;
+  z = z + t;
+  t = (m < 0x40000000) << 1;
+  m = m << t;
+  z = z + t;
+  t = m < 0x80000000;
+  m = m << t;             //the leading 1 now at bit 31
+  z = z + t;
+
+  f = m >> 8;             //the leading 1 at bit 23 and the 23 fraction bits below it
+
+  up = ((m & 0xFF) + (f & 1)) > 0x80;  //round to nearest: more than half, or exactly half and f odd (ties to even)
+
+  return ((base - z) << 23) + f + up;  //the leading 1 adds 1 to the exponent, and a carry out of rounding one more
 }
+
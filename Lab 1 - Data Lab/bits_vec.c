@@ -0,0 +1,164 @@
+/*
+ * bits_vec.c - Array versions of the bits.c puzzles.
+ *
+ * These live outside bits.c because dlc allows no extra functions, types
+ * or casts there. Each kernel works on LANES values at a time with GCC
+ * vector extensions, which compile to whatever SIMD the target has:
+ * SSE2 by default on x86-64, AVX2 with -mavx2, NEON on ARM. Each lane
+ * does the same branch-free arithmetic as the scalar puzzle, comparisons
+ * giving all-ones or all-zeros masks instead of branches. A partial last
+ * vector is loaded zero-padded and only its real lanes stored, so every
+ * value takes the same arithmetic.
+ *
+ * Build:
+ *
+ *   gcc -O2 -mavx2 -c bits_vec.c
+ */
+
+#include <string.h>
+
+#include "bits_vec.h"
+
+#ifdef __AVX2__
+#define LANES 8   // 32-bit values per vector: one AVX2 register
+#else
+#define LANES 4   // one SSE or NEON register
+#endif
+
+typedef int vint __attribute__((vector_size(LANES * sizeof(int))));
+typedef unsigned vuns __attribute__((vector_size(LANES * sizeof(unsigned))));
+typedef float vflt __attribute__((vector_size(LANES * sizeof(float))));
+
+/*
+ * Load up to LANES values from p (count of them, the rest zero), and store
+ * the first count lanes of v to p; memcpy keeps unaligned pointers legal
+ */
+static inline vuns load(const void *p, size_t count)
+{
+    vuns v = { 0 };
+
+    memcpy(&v, p, (count < LANES ? count : LANES) * sizeof(unsigned));
+    return v;
+}
+
+static inline void store(void *p, vuns v, size_t count)
+{
+    memcpy(p, &v, (count < LANES ? count : LANES) * sizeof(unsigned));
+}
+
+/*
+ * isNan - all-ones in the lanes where uf is a NaN: its magnitude is
+ *         greater than infinity's
+ */
+static inline vuns isNan(vuns uf)
+{
+    return (vuns) ((uf & 0x7FFFFFFF) > 0x7F800000);
+}
+
+/*
+ * The lanes of each kernel
+ */
+static inline vuns negateLanes(vuns f)
+{
+    return f ^ (0x80000000 & ~isNan(f));  //flip the sign bit, except of NaNs
+}
+
+static inline vuns isEqualLanes(vuns f, vuns g)
+{
+    vuns same = (vuns) (f == g);
+    vuns zeros = (vuns) (((f | g) << 1) == 0);  //+0 and -0
+
+    return (same | zeros) & ~(isNan(f) | isNan(g)) & 1;
+}
+
+static inline vuns int2FloatLanes(vuns x)
+{
+    vflt f = __builtin_convertvector((vint) x, vflt);  //the SIMD convert rounds to nearest even, as (float) does
+
+    return (vuns) f;
+}
+
+static inline vuns addOKLanes(vuns x, vuns y)
+{
+    vuns c = x + y;  //unsigned, so wrapping around is defined
+
+    return (((x ^ c) & (y ^ c)) >> 31) ^ 1;  //overflow: x and y share a sign that x+y lacks
+}
+
+/*
+ * Each entry point runs its lanes over whole vectors, then once over the
+ * partial vector left at the end, if any
+ */
+void floatNegate_n(const unsigned *uf, unsigned *out, size_t count)
+{
+    size_t i = 0;
+
+    for (; i + LANES <= count; i += LANES) {
+        store(out + i, negateLanes(load(uf + i, LANES)), LANES);
+    }
+    if (i < count) {
+        store(out + i, negateLanes(load(uf + i, count - i)), count - i);
+    }
+}
+
+void floatIsEqual_n(const unsigned *uf, const unsigned *ug, int *out, size_t count)
+{
+    size_t i = 0;
+
+    for (; i + LANES <= count; i += LANES) {
+        store(out + i, isEqualLanes(load(uf + i, LANES), load(ug + i, LANES)), LANES);
+    }
+    if (i < count) {
+        store(out + i, isEqualLanes(load(uf + i, count - i), load(ug + i, count - i)), count - i);
+    }
+}
+
+void floatInt2Float_n(const int *x, unsigned *out, size_t count)
+{
+    size_t i = 0;
+
+    for (; i + LANES <= count; i += LANES) {
+        store(out + i, int2FloatLanes(load(x + i, LANES)), LANES);
+    }
+    if (i < count) {
+        store(out + i, int2FloatLanes(load(x + i, count - i)), count - i);
+    }
+}
+
+void addOK_n(const int *x, const int *y, int *out, size_t count)
+{
+    size_t i = 0;
+
+    for (; i + LANES <= count; i += LANES) {
+        store(out + i, addOKLanes(load(x + i, LANES), load(y + i, LANES)), LANES);
+    }
+    if (i < count) {
+        store(out + i, addOKLanes(load(x + i, count - i), load(y + i, count - i)), count - i);
+    }
+}
+
+void getByte_n(const int *x, int n, int *out, size_t count)
+{
+    unsigned shift = (unsigned) n << 3;
+    size_t i = 0;
+
+    for (; i + LANES <= count; i += LANES) {
+        store(out + i, (load(x + i, LANES) >> shift) & 0xFF, LANES);
+    }
+    if (i < count) {
+        store(out + i, (load(x + i, count - i) >> shift) & 0xFF, count - i);
+    }
+}
+
+void invert_n(const int *x, int p, int n, int *out, size_t count)
+{
+    unsigned mask = ~(~0u << n) << p;  //the n bits from p, as in invert
+    size_t i = 0;
+
+    for (; i + LANES <= count; i += LANES) {
+        store(out + i, load(x + i, LANES) ^ mask, LANES);
+    }
+    if (i < count) {
+        store(out + i, load(x + i, count - i) ^ mask, count - i);
+    }
+}
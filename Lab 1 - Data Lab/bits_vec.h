@@ -0,0 +1,49 @@
+/*
+ * bits_vec.h - Array versions of the bits.c puzzles, for converting and
+ *              checking whole buffers at once.
+ *
+ * Each function applies the bits.c function of the same name (without the
+ * _n) to count values, element by element, and gives bit-for-bit the same
+ * results. The bits.c functions stay the reference; these are the fast
+ * path. Input and output arrays may be unaligned, but must not overlap
+ * unless they are the same array.
+ */
+
+#ifndef BITS_VEC_H
+#define BITS_VEC_H
+
+#include <stddef.h>
+
+/*
+ * floatNegate_n - out[i] = floatNegate(uf[i])
+ */
+void floatNegate_n(const unsigned *uf, unsigned *out, size_t count);
+
+/*
+ * floatIsEqual_n - out[i] = floatIsEqual(uf[i], ug[i])
+ */
+void floatIsEqual_n(const unsigned *uf, const unsigned *ug, int *out, size_t count);
+
+/*
+ * floatInt2Float_n - out[i] = the bit-level representation of (float) x[i],
+ *   rounded to nearest even, which is what floatInt2Float must return
+ */
+void floatInt2Float_n(const int *x, unsigned *out, size_t count);
+
+/*
+ * addOK_n - out[i] = addOK(x[i], y[i])
+ */
+void addOK_n(const int *x, const int *y, int *out, size_t count);
+
+/*
+ * getByte_n - out[i] = getByte(x[i], n): byte n of every value, 0 <= n <= 3
+ */
+void getByte_n(const int *x, int n, int *out, size_t count);
+
+/*
+ * invert_n - out[i] = invert(x[i], p, n): the same n bits from position p
+ *   inverted in every value
+ */
+void invert_n(const int *x, int p, int n, int *out, size_t count);
+
+#endif
@@ -0,0 +1,229 @@
+/*
+ * bits_vec_test.c - Checks every bits_vec.c kernel against the bits.c
+ *                   function it stands for.
+ *
+ * Each kernel is run over random values and over the special ones (+-0,
+ * +-inf, NaNs, denormals, Tmin, Tmax and powers of two and their
+ * neighbours), with every n for getByte_n and every p and n for invert_n.
+ * Inputs start at every offset within a vector, and counts run from 0 to a
+ * few vectors' worth, so the unaligned heads and odd tails are covered as
+ * well as the vector loop; the element after the last is checked to be
+ * left alone. Prints the first few mismatches and exits nonzero if there
+ * are any.
+ *
+ * Build it both ways, as bits_vec.c has a path for each (bits.c includes
+ * common.h from the lab handout; pass -DCOMMON_H to build it without):
+ *
+ *   gcc -O2 -o bits_vec_test bits_vec_test.c bits_vec.c bits.c
+ *   gcc -O2 -mavx2 -o bits_vec_test bits_vec_test.c bits_vec.c bits.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "bits_vec.h"
+
+/* The puzzles, as bits.h from the handout declares them */
+int getByte(int, int);
+int invert(int, int, int);
+int addOK(int, int);
+unsigned floatNegate(unsigned);
+int floatIsEqual(unsigned, unsigned);
+unsigned floatInt2Float(int);
+
+#define NUM_VALUES 4096     // values in each input array
+#define MAX_OFFSET 8        // starts tried within a vector: every one for AVX2
+#define MAX_SHORT 40        // counts up to this are all tried, then NUM_VALUES
+#define MAX_REPORTS 10      // mismatches printed before going quiet
+#define CANARY 0xA5A5A5A5u  // what the element after the last must still hold
+
+/* A kernel under test and its reference; p and n are ignored by the ones without them */
+typedef struct {
+    const char *name;
+    void (*run)(const unsigned *a, const unsigned *b, int p, int n, unsigned *out, size_t count);
+    unsigned (*ref)(unsigned a, unsigned b, int p, int n);
+    int max_p;      // p runs from 0 to max_p
+    int max_n;      // n runs from 0 to max_n
+} kernel_t;
+
+static void runFloatNegate(const unsigned *a, const unsigned *b, int p, int n, unsigned *out, size_t count)
+{
+    (void) b; (void) p; (void) n;
+    floatNegate_n(a, out, count);
+}
+
+static void runFloatIsEqual(const unsigned *a, const unsigned *b, int p, int n, unsigned *out, size_t count)
+{
+    (void) p; (void) n;
+    floatIsEqual_n(a, b, (int *) out, count);
+}
+
+static void runFloatInt2Float(const unsigned *a, const unsigned *b, int p, int n, unsigned *out, size_t count)
+{
+    (void) b; (void) p; (void) n;
+    floatInt2Float_n((const int *) a, out, count);
+}
+
+static void runAddOK(const unsigned *a, const unsigned *b, int p, int n, unsigned *out, size_t count)
+{
+    (void) p; (void) n;
+    addOK_n((const int *) a, (const int *) b, (int *) out, count);
+}
+
+static void runGetByte(const unsigned *a, const unsigned *b, int p, int n, unsigned *out, size_t count)
+{
+    (void) b; (void) p;
+    getByte_n((const int *) a, n, (int *) out, count);
+}
+
+static void runInvert(const unsigned *a, const unsigned *b, int p, int n, unsigned *out, size_t count)
+{
+    (void) b;
+    invert_n((const int *) a, p, n, (int *) out, count);
+}
+
+static unsigned refFloatNegate(unsigned a, unsigned b, int p, int n) { (void) b; (void) p; (void) n; return floatNegate(a); }
+static unsigned refFloatIsEqual(unsigned a, unsigned b, int p, int n) { (void) p; (void) n; return floatIsEqual(a, b); }
+static unsigned refFloatInt2Float(unsigned a, unsigned b, int p, int n) { (void) b; (void) p; (void) n; return floatInt2Float(a); }
+static unsigned refAddOK(unsigned a, unsigned b, int p, int n) { (void) p; (void) n; return addOK(a, b); }
+static unsigned refGetByte(unsigned a, unsigned b, int p, int n) { (void) b; (void) p; return getByte(a, n); }
+static unsigned refInvert(unsigned a, unsigned b, int p, int n) { (void) b; return invert(a, p, n); }
+
+static const kernel_t kernels[] = {
+    { "floatNegate_n", runFloatNegate, refFloatNegate, 0, 0 },
+    { "floatIsEqual_n", runFloatIsEqual, refFloatIsEqual, 0, 0 },
+    { "floatInt2Float_n", runFloatInt2Float, refFloatInt2Float, 0, 0 },
+    { "addOK_n", runAddOK, refAddOK, 0, 0 },
+    { "getByte_n", runGetByte, refGetByte, 0, 3 },
+    { "invert_n", runInvert, refInvert, 31, 31 },
+};
+
+#define NUM_KERNELS ((int) (sizeof(kernels) / sizeof(kernels[0])))
+
+/* The inputs: a[i] and b[i] for each element, with room to start late */
+static unsigned a[NUM_VALUES + MAX_OFFSET];
+static unsigned b[NUM_VALUES + MAX_OFFSET];
+static unsigned out[NUM_VALUES + MAX_OFFSET + 1];
+
+static long mismatches = 0;
+
+/*
+ * rnd - xorshift random numbers, so every run checks the same inputs
+ */
+static unsigned rnd(void)
+{
+    static uint64_t state = 0x9E3779B97F4A7C15ull;
+
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (unsigned) (state >> 32);
+}
+
+/*
+ * gen_value - A random value, a special one or an edge case, about a
+ *             third of the time each
+ */
+static unsigned gen_value(void)
+{
+    static const unsigned special[] = {
+        0x00000000, 0x80000000, 0x7F800000, 0xFF800000, 0x7FC00000, 0xFFC00000,
+        0x7F800001, 0xFF800001, 0x7FFFFFFF, 0xFFFFFFFF, 0x00000001, 0x80000001,
+        0x007FFFFF, 0x807FFFFF, 0x00800000, 0x80800000, 0x7F7FFFFF, 0xFF7FFFFF,
+    };
+    unsigned k = rnd();
+    int shift = (int) (k & 31);
+
+    switch (k % 3) {
+    case 0:
+        return special[rnd() % (sizeof(special) / sizeof(special[0]))];
+    case 1:
+        switch ((k >> 8) % 5) {
+        case 0: return 1u << shift;
+        case 1: return (1u << shift) - 1;
+        case 2: return (1u << shift) + 1;
+        case 3: return -(1u << shift);
+        default: return -(1u << shift) - 1;
+        }
+    default:
+        return rnd();
+    }
+}
+
+/*
+ * fill_inputs - Fill a and b. b is a itself, a with the sign flipped (so
+ *               +0 meets -0) or another value, a third of the time each,
+ *               so floatIsEqual_n sees equal values too.
+ */
+static void fill_inputs(void)
+{
+    for (size_t i = 0; i < NUM_VALUES + MAX_OFFSET; i++) {
+        a[i] = gen_value();
+        switch (rnd() % 3) {
+        case 0: b[i] = a[i]; break;
+        case 1: b[i] = a[i] ^ 0x80000000; break;
+        default: b[i] = gen_value(); break;
+        }
+    }
+}
+
+/*
+ * check_run - Run one kernel with one p and n over count elements from
+ *             offset, and compare against its reference
+ */
+static void check_run(const kernel_t *k, int p, int n, size_t offset, size_t count)
+{
+    unsigned *dst = out + (offset + 1) % MAX_OFFSET;   //the output unaligned differently from the input
+
+    for (size_t i = 0; i <= count; i++) {
+        dst[i] = CANARY;
+    }
+    k->run(a + offset, b + offset, p, n, dst, count);
+
+    for (size_t i = 0; i <= count; i++) {
+        unsigned want = (i < count) ? k->ref(a[offset + i], b[offset + i], p, n) : CANARY;
+
+        if (dst[i] != want) {
+            if (mismatches < MAX_REPORTS) {
+                printf("%s: p=%d n=%d offset=%zu count=%zu: element %zu of 0x%08x, 0x%08x is 0x%08x, not 0x%08x\n",
+                       k->name, p, n, offset, count, i,
+                       i < count ? a[offset + i] : 0, i < count ? b[offset + i] : 0, dst[i], want);
+            }
+            mismatches++;
+        }
+    }
+}
+
+/*
+ * main - Main routine
+ */
+int main(void)
+{
+    fill_inputs();
+
+    for (int t = 0; t < NUM_KERNELS; t++) {
+        const kernel_t *k = &kernels[t];
+        long before = mismatches;
+
+        for (int p = 0; p <= k->max_p; p++) {
+            for (int n = 0; n <= k->max_n; n++) {
+                for (size_t offset = 0; offset < MAX_OFFSET; offset++) {
+                    for (size_t count = 0; count <= MAX_SHORT; count++) {
+                        check_run(k, p, n, offset, count);
+                    }
+                    check_run(k, p, n, offset, NUM_VALUES);
+                }
+            }
+        }
+
+        printf("%-18s %s\n", k->name, mismatches == before ? "ok" : "FAILED");
+    }
+
+    if (mismatches != 0) {
+        printf("%ld mismatches\n", mismatches);
+        return 1;
+    }
+    return 0;
+}
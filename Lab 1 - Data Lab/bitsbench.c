@@ -0,0 +1,285 @@
+/*
+ * bitsbench.c - Times every bits.c puzzle function over several sets of
+ *               inputs, to show which ones cost more on some values than
+ *               on others.
+ *
+ * Each input set is an array of argument triples, used as each puzzle
+ * needs (getByte takes the second argument mod 4, invert the second and
+ * third mod 32):
+ *
+ *   random   uniformly random 32-bit values
+ *   small    integers from -256 to 255
+ *   wide     integers of magnitude 2^24 or more, which floatInt2Float
+ *            has to round
+ *   ties     integers exactly halfway between two floats
+ *   edge     0, +-1, Tmin, Tmax and powers of two and their neighbours
+ *   special  floats: +-0, +-inf, NaNs, denormals and the largest and
+ *            smallest normalized values
+ *
+ * Every puzzle is called through a pointer, like the baseline row, which
+ * only returns its first argument; subtract that row to get the cost of
+ * the puzzle itself. The arrays are run over reps times and the best
+ * run's time per call is reported.
+ *
+ * Build (bits.c includes common.h from the lab handout; pass -DCOMMON_H to
+ * build it without):
+ *
+ *   gcc -O2 -o bitsbench bitsbench.c bits.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+/* The puzzles, as bits.h from the handout declares them */
+int bitAnd(int, int);
+int bitXor(int, int);
+int getByte(int, int);
+int invert(int, int, int);
+int sign(int);
+int addOK(int, int);
+unsigned floatNegate(unsigned);
+int floatIsEqual(unsigned, unsigned);
+unsigned floatInt2Float(int);
+
+/* One call of a puzzle, with its arguments */
+typedef unsigned (*call_t)(unsigned a, unsigned b, unsigned c);
+
+static unsigned callBaseline(unsigned a, unsigned b, unsigned c) { (void) b; (void) c; return a; }
+static unsigned callBitAnd(unsigned a, unsigned b, unsigned c) { (void) c; return bitAnd(a, b); }
+static unsigned callBitXor(unsigned a, unsigned b, unsigned c) { (void) c; return bitXor(a, b); }
+static unsigned callGetByte(unsigned a, unsigned b, unsigned c) { (void) c; return getByte(a, b & 3); }
+static unsigned callInvert(unsigned a, unsigned b, unsigned c) { return invert(a, b & 31, c & 31); }
+static unsigned callSign(unsigned a, unsigned b, unsigned c) { (void) b; (void) c; return sign(a); }
+static unsigned callAddOK(unsigned a, unsigned b, unsigned c) { (void) c; return addOK(a, b); }
+static unsigned callFloatNegate(unsigned a, unsigned b, unsigned c) { (void) b; (void) c; return floatNegate(a); }
+static unsigned callFloatIsEqual(unsigned a, unsigned b, unsigned c) { (void) c; return floatIsEqual(a, b); }
+static unsigned callFloatInt2Float(unsigned a, unsigned b, unsigned c) { (void) b; (void) c; return floatInt2Float(a); }
+
+static const struct {
+    const char *name;
+    call_t call;
+} puzzles[] = {
+    { "baseline", callBaseline },
+    { "bitAnd", callBitAnd },
+    { "bitXor", callBitXor },
+    { "getByte", callGetByte },
+    { "invert", callInvert },
+    { "sign", callSign },
+    { "addOK", callAddOK },
+    { "floatNegate", callFloatNegate },
+    { "floatIsEqual", callFloatIsEqual },
+    { "floatInt2Float", callFloatInt2Float },
+};
+
+#define NUM_PUZZLES ((int) (sizeof(puzzles) / sizeof(puzzles[0])))
+
+/* Type of one input set */
+typedef enum { SET_RANDOM, SET_SMALL, SET_WIDE, SET_TIES, SET_EDGE, SET_SPECIAL, NUM_SETS } set_type_t;
+
+static const char *set_names[NUM_SETS] = { "random", "small", "wide", "ties", "edge", "special" };
+
+/* One input set: arguments a[i], b[i], c[i] for each call */
+typedef struct {
+    unsigned *a;
+    unsigned *b;
+    unsigned *c;
+} input_set_t;
+
+/* Globals set by command line args */
+static size_t num_inputs = 1 << 16;
+static int reps = 20;
+
+volatile unsigned sink;   // keeps the results, and so the calls, alive
+
+/*
+ * now_ns - monotonic clock in nanoseconds
+ */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/*
+ * rnd - xorshift random numbers, so every run times the same inputs
+ */
+static unsigned rnd(void)
+{
+    static uint64_t state = 0x9E3779B97F4A7C15ull;
+
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (unsigned) (state >> 32);
+}
+
+/*
+ * gen_value - The next value of an input set
+ */
+static unsigned gen_value(set_type_t set)
+{
+    static const unsigned special[] = {
+        0x00000000, 0x80000000, 0x7F800000, 0xFF800000, 0x7FC00000, 0xFFC00000,
+        0x7F800001, 0x00000001, 0x007FFFFF, 0x00800000, 0x7F7FFFFF, 0x80800000,
+    };
+    unsigned k = rnd();
+    int shift = (int) (k & 31);
+
+    switch (set) {
+    case SET_SMALL:
+        return (k & 0x1FF) - 256;
+    case SET_WIDE: {
+        unsigned mag = (k | 0x01000000) & 0x7FFFFFFF;   //at least 2^24
+        return (k >> 31) ? -mag : mag;
+    }
+    case SET_TIES: {
+        int s = 1 + (int) (k % 7);                      //a 24-bit odd or even mantissa, then a half
+        unsigned mant = (rnd() & 0x7FFFFF) | 0x800000;
+        unsigned tie = ((mant << 1) | 1) << (s - 1);
+        return (k >> 31) ? -tie : tie;
+    }
+    case SET_EDGE:
+        switch (k >> 29) {
+        case 0: return 0;
+        case 1: return 1;
+        case 2: return -1;
+        case 3: return 0x80000000;
+        case 4: return 0x7FFFFFFF;
+        case 5: return 1u << shift;
+        case 6: return (1u << shift) - 1;
+        default: return (1u << shift) + 1;
+        }
+    case SET_SPECIAL:
+        return special[k % (sizeof(special) / sizeof(special[0]))];
+    default:
+        return k;
+    }
+}
+
+/*
+ * make_set - Fill an input set. Second arguments are the first one half
+ *            the time, so floatIsEqual sees equal values too.
+ */
+static void make_set(input_set_t *in, set_type_t set)
+{
+    in->a = malloc(num_inputs * sizeof(unsigned));
+    in->b = malloc(num_inputs * sizeof(unsigned));
+    in->c = malloc(num_inputs * sizeof(unsigned));
+
+    for (size_t i = 0; i < num_inputs; i++) {
+        in->a[i] = gen_value(set);
+        in->b[i] = (rnd() & 1) ? in->a[i] : gen_value(set);
+        in->c[i] = gen_value(set);
+    }
+}
+
+/*
+ * time_calls - Best time per call, in ns, of a puzzle over an input set
+ */
+static double time_calls(call_t call, const input_set_t *in)
+{
+    uint64_t best = UINT64_MAX;
+
+    for (int r = 0; r < reps; r++) {
+        unsigned acc = 0;
+        uint64_t start = now_ns();
+
+        for (size_t i = 0; i < num_inputs; i++) {
+            acc += call(in->a[i], in->b[i], in->c[i]);
+        }
+
+        uint64_t t = now_ns() - start;
+        if (t < best) {
+            best = t;
+        }
+        sink = acc;
+    }
+
+    return (double) best / (double) num_inputs;
+}
+
+/*
+ * printUsage - Print usage info
+ */
+static void printUsage(char *argv[])
+{
+    printf("Usage: %s [-h] [-n <num>] [-r <reps>] [-f <name>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -n <num>   Inputs in each set (default %zu).\n", num_inputs);
+    printf("  -r <reps>  Runs over each set; the best is reported (default %d).\n", reps);
+    printf("  -f <name>  Time only the named puzzle (and the baseline).\n");
+    printf("\nExample:\n");
+    printf("  linux>  %s -f floatInt2Float\n", argv[0]);
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char *argv[])
+{
+    const char *only = NULL;
+    input_set_t sets[NUM_SETS];
+    int c;
+
+    while ((c = getopt(argc, argv, "hn:r:f:")) != -1) {
+        switch (c) {
+        case 'n':
+            num_inputs = (size_t) atol(optarg);
+            break;
+        case 'r':
+            reps = atoi(optarg);
+            break;
+        case 'f':
+            only = optarg;
+            break;
+        case 'h':
+            printUsage(argv);
+            exit(0);
+        default:
+            printUsage(argv);
+            exit(1);
+        }
+    }
+
+    if (num_inputs == 0 || reps < 1) {
+        printUsage(argv);
+        exit(1);
+    }
+
+    for (int s = 0; s < NUM_SETS; s++) {
+        make_set(&sets[s], (set_type_t) s);
+    }
+
+    printf("%-16s", "ns/call");
+    for (int s = 0; s < NUM_SETS; s++) {
+        printf(" %8s", set_names[s]);
+    }
+    printf("\n");
+
+    for (int p = 0; p < NUM_PUZZLES; p++) {
+        if (only != NULL && p != 0 && strcmp(only, puzzles[p].name) != 0) {
+            continue;
+        }
+
+        printf("%-16s", puzzles[p].name);
+        for (int s = 0; s < NUM_SETS; s++) {
+            printf(" %8.2f", time_calls(puzzles[p].call, &sets[s]));
+        }
+        printf("\n");
+    }
+
+    for (int s = 0; s < NUM_SETS; s++) {
+        free(sets[s].a);
+        free(sets[s].b);
+        free(sets[s].c);
+    }
+    return 0;
+}
@@ -0,0 +1,302 @@
+/*
+ * pointer_fast.c - Fast versions of the pointer.c string and sort
+ *                  functions.
+ *
+ * These live outside pointer.c because the lab's rules allow no extra
+ * functions there, nor the bit operators they need.
+ *
+ * stringLengthFast checks the aligned block s starts in, a vector register
+ * with SSE2 or AVX2, else a word, and hands anything longer to libc's
+ * strlen. An aligned block can't straddle a page boundary, by the same math
+ * as withinSameBlock: its first and last bytes' addresses agree above the
+ * low bits, so everything it reads is on a page the string's own bytes are
+ * on, even before s or past the terminator. That one block is what beats
+ * the original, which gcc compiles to a strlen call at -O2: a short string
+ * is done without the call. Past it glibc's strlen, which picks an AVX2
+ * loop at run time where the CPU has one, is faster than any loop here;
+ * ptrbench measured a four-block loop at twice its time from 512 bytes up.
+ *
+ * fastSort picks between an introsort (quicksort with a heapsort fallback
+ * and insertion sort for short ranges) and an LSD radix sort, which does
+ * four linear passes but needs a second array; RADIX_MIN is where the
+ * radix sort starts to win on random ints, as measured with ptrbench on a
+ * fresh array each time: about 31 against 21 ns per element at 32 ints,
+ * 19 against 26 at 64, and four to five times faster from 256 up.
+ * Long arrays that are already in order are left as they are.
+ *
+ * Build (pointer.c includes common.h from the lab handout; pass -DCOMMON_H
+ * to build it without):
+ *
+ *   gcc -O2 -o ptrbench ptrbench.c pointer_fast.c pointer.c
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pointer_fast.h"
+
+#define INSERTION_MAX 16    // ranges this short are insertion sorted
+#define RADIX_MIN 64        // arrays this long are radix sorted
+
+#if defined(__AVX2__)
+#define BLOCK 32   // bytes stringLengthFast checks itself: one AVX2 register
+#elif defined(__SSE2__)
+#define BLOCK 16   // one SSE register
+#else
+#define BLOCK 8    // one word, where there's no x86 SIMD
+#endif
+
+typedef uint64_t word_t;
+
+#define LOWS ((word_t) -1 / 0xFF * 0x7F)   // 0x7F7F...7F
+
+#if BLOCK > 8
+typedef char vbyte __attribute__((vector_size(BLOCK)));
+#endif
+
+/*
+ * zeroBits - Bit k set if byte k of the aligned block at p is zero
+ */
+static inline unsigned zeroBits(const char *p)
+{
+#if BLOCK > 8
+    vbyte v;
+
+    memcpy(&v, p, sizeof(v));   //one aligned load
+#ifdef __AVX2__
+    return (unsigned) __builtin_ia32_pmovmskb256(v == 0);
+#else
+    return (unsigned) __builtin_ia32_pmovmskb128(v == 0);
+#endif
+#else
+    word_t w;
+
+    memcpy(&w, p, sizeof(w));   //one aligned load
+    word_t zeros = ~(((w & LOWS) + LOWS) | w | LOWS);   //high bit set in exactly the zero bytes
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    zeros = __builtin_bswap64(zeros);   //byte k of memory to bits 8k..8k+7
+#endif
+    return (unsigned) (((zeros >> 7) * 0x0102040810204080) >> 56);   //bit 8k to bit 56+k, then down to k
+#endif
+}
+
+/*
+ * stringLengthFast - Length of s, reading only aligned blocks. Reads up to
+ *   a block before s and after its terminator, which address checkers
+ *   would flag even though it is always on a mapped page. If the first
+ *   block has no terminator, strlen finishes from the next one.
+ */
+__attribute__((no_sanitize_address))
+int stringLengthFast(char *s)
+{
+    const char *p = (const char *) ((uintptr_t) s & ~(uintptr_t) (BLOCK - 1));   //the block s starts in
+    unsigned hits = zeroBits(p) & (~0u << (s - p));   //less the bytes before s
+
+    if (hits == 0) {
+        p += BLOCK;
+        return (int) (p - s) + (int) strlen(p);
+    }
+    return (int) (p - s) + __builtin_ctz(hits);
+}
+
+/*
+ * swap - Exchange two ints, as swapInts does
+ */
+static inline void swap(int *a, int *b)
+{
+    int t = *a;
+
+    *a = *b;
+    *b = t;
+}
+
+/*
+ * insertionSort - Sort arr[lo..hi], which should be short
+ */
+static void insertionSort(int *arr, int lo, int hi)
+{
+    for (int i = lo + 1; i <= hi; i++) {
+        int v = arr[i];
+        int j = i;
+
+        while (j > lo && arr[j - 1] > v) {
+            arr[j] = arr[j - 1];
+            j--;
+        }
+        arr[j] = v;
+    }
+}
+
+/*
+ * siftDown - Restore the max-heap below node i of the n-element heap at arr
+ */
+static void siftDown(int *arr, int i, int n)
+{
+    int v = arr[i];
+
+    for (;;) {
+        int child = 2 * i + 1;
+
+        if (child >= n) {
+            break;
+        }
+        if (child + 1 < n && arr[child + 1] > arr[child]) {
+            child++;
+        }
+        if (arr[child] <= v) {
+            break;
+        }
+        arr[i] = arr[child];
+        i = child;
+    }
+    arr[i] = v;
+}
+
+/*
+ * heapSort - Sort the n ints at arr in O(n log n) time, whatever their order
+ */
+static void heapSort(int *arr, int n)
+{
+    for (int i = n / 2 - 1; i >= 0; i--) {
+        siftDown(arr, i, n);
+    }
+    for (int end = n - 1; end > 0; end--) {
+        swap(arr, arr + end);
+        siftDown(arr, 0, end);
+    }
+}
+
+/*
+ * introLoop - Quicksort arr[lo..hi] around median-of-three pivots, handing
+ *   the range to heapSort once depth runs out. Recurses on the smaller
+ *   side and loops on the larger, so the stack stays O(log n).
+ */
+static void introLoop(int *arr, int lo, int hi, int depth)
+{
+    while (hi - lo + 1 > INSERTION_MAX) {
+        if (depth-- == 0) {
+            heapSort(arr + lo, hi - lo + 1);
+            return;
+        }
+
+        int mid = lo + (hi - lo) / 2;
+        if (arr[mid] < arr[lo]) {
+            swap(&arr[mid], &arr[lo]);
+        }
+        if (arr[hi] < arr[lo]) {
+            swap(&arr[hi], &arr[lo]);
+        }
+        if (arr[hi] < arr[mid]) {
+            swap(&arr[hi], &arr[mid]);
+        }
+        int pivot = arr[mid];   //the median of arr[lo], arr[mid] and arr[hi]
+
+        int i = lo;
+        int j = hi;
+        while (i <= j) { //Hoare partition: all of arr[lo..j] <= pivot <= all of arr[i..hi]
+            while (arr[i] < pivot) {
+                i++;
+            }
+            while (arr[j] > pivot) {
+                j--;
+            }
+            if (i <= j) {
+                swap(&arr[i], &arr[j]);
+                i++;
+                j--;
+            }
+        }
+
+        if (j - lo < hi - i) {
+            introLoop(arr, lo, j, depth);
+            lo = i;
+        } else {
+            introLoop(arr, i, hi, depth);
+            hi = j;
+        }
+    }
+
+    insertionSort(arr, lo, hi);
+}
+
+void introSort(int arr[], int arrLength)
+{
+    int depth = 0;
+
+    for (int n = arrLength; n > 1; n >>= 1) {
+        depth += 2;   //2 log2 n levels before giving up on quicksort
+    }
+    if (arrLength > 1) {
+        introLoop(arr, 0, arrLength - 1, depth);
+    }
+}
+
+void radixSort(int arr[], int arrLength)
+{
+    size_t n = arrLength > 0 ? (size_t) arrLength : 0;
+    size_t counts[4][256] = { { 0 } };
+    uint32_t *src = (uint32_t *) arr;
+    uint32_t *tmp;
+
+    if (n < 2) {
+        return;
+    }
+
+    tmp = malloc(n * sizeof(uint32_t));
+    if (tmp == NULL) {
+        introSort(arr, arrLength);
+        return;
+    }
+
+    for (size_t i = 0; i < n; i++) { //count every pass's digits in one read of arr
+        uint32_t key = src[i] ^ 0x80000000;   //flipping the sign bit orders ints as unsigned
+        for (int d = 0; d < 4; d++) {
+            counts[d][(key >> (8 * d)) & 0xFF]++;
+        }
+    }
+
+    uint32_t *dst = tmp;
+    for (int d = 0; d < 4; d++) {
+        size_t *count = counts[d];
+
+        if (count[((src[0] ^ 0x80000000) >> (8 * d)) & 0xFF] == n) {
+            continue;   //every key has the same digit here: the pass wouldn't move anything
+        }
+
+        size_t sum = 0;
+        for (int b = 0; b < 256; b++) { //counts become where each digit's run starts
+            size_t c = count[b];
+            count[b] = sum;
+            sum += c;
+        }
+        for (size_t i = 0; i < n; i++) {
+            uint32_t v = src[i];
+            dst[count[((v ^ 0x80000000) >> (8 * d)) & 0xFF]++] = v;
+        }
+
+        uint32_t *t = src;
+        src = dst;
+        dst = t;
+    }
+
+    if (src != (uint32_t *) arr) {
+        memcpy(arr, src, n * sizeof(uint32_t));   //an odd number of passes left the result in tmp
+    }
+    free(tmp);
+}
+
+void fastSort(int arr[], int arrLength)
+{
+    if (arrLength < RADIX_MIN) {
+        introSort(arr, arrLength);
+        return;
+    }
+
+    for (int i = 1; i < arrLength; i++) { //radixSort does all its passes even on sorted input
+        if (arr[i - 1] > arr[i]) {
+            radixSort(arr, arrLength);
+            return;
+        }
+    }
+}
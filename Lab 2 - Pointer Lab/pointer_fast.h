@@ -0,0 +1,37 @@
+/*
+ * pointer_fast.h - Fast versions of the pointer.c string and sort
+ *                  functions, for use outside the lab.
+ *
+ * Each gives the same results as the pointer.c function it replaces,
+ * which stays the reference.
+ */
+
+#ifndef POINTER_FAST_H
+#define POINTER_FAST_H
+
+/*
+ * stringLengthFast - stringLength(s): checks the first aligned block
+ *   itself and leaves the rest of a longer string to libc's strlen
+ */
+int stringLengthFast(char *s);
+
+/*
+ * fastSort - Sort arr into ascending order, like selectionSort(arr,
+ *   arrLength) and with the same signature, in O(n log n) time: introSort
+ *   for short arrays and radixSort for long ones that aren't already sorted
+ */
+void fastSort(int arr[], int arrLength);
+
+/*
+ * introSort - Sort arr in place: quicksort, falling back to heapsort if
+ *   the recursion gets too deep and to insertion sort for short ranges
+ */
+void introSort(int arr[], int arrLength);
+
+/*
+ * radixSort - Sort arr with an LSD radix sort, one byte per pass. Needs a
+ *   temporary copy of arr: if that can't be allocated, sorts with introSort.
+ */
+void radixSort(int arr[], int arrLength);
+
+#endif
@@ -0,0 +1,302 @@
+/*
+ * ptrbench.c - Times the pointer.c string and sort functions against the
+ *              versions in pointer_fast.c across sizes, to show where each
+ *              one starts to win.
+ *
+ * The string table gives ns per call of stringLength, stringLengthFast and
+ * libc strlen for strings of each length, averaged over every alignment of
+ * the string's start within a word. The sort table gives ns per element of
+ * selectionSort, introSort, radixSort and fastSort on random ints (and on
+ * already sorted ones with -s); selectionSort is skipped above -m elements
+ * since it takes quadratic time. Each repetition sorts a different random
+ * array, cut in turn from a pool bigger than the cache, so neither the
+ * branch predictor nor the cache gets to learn the input. Every sort's output is checked against
+ * libc qsort's, which none of them share code with.
+ *
+ * At -O2 gcc recognizes stringLength's loop and compiles it to a call to
+ * strlen; time the loop as written by building pointer.c with
+ * -fno-tree-loop-distribute-patterns.
+ *
+ * Build (pointer.c includes common.h from the lab handout; pass -DCOMMON_H
+ * to build it without):
+ *
+ *   gcc -O2 -o ptrbench ptrbench.c pointer_fast.c pointer.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "pointer_fast.h"
+
+/* The pointer.c functions, as common.h from the handout declares them */
+int stringLength(char *s);
+void selectionSort(int arr[], int arrLength);
+
+/* A sort under test */
+typedef struct {
+    const char *name;
+    void (*sort)(int arr[], int arrLength);
+    int quadratic;   // skipped above max_quadratic elements
+} sorter_t;
+
+static const sorter_t sorters[] = {
+    { "selection", selectionSort, 1 },
+    { "intro", introSort, 0 },
+    { "radix", radixSort, 0 },
+    { "fastSort", fastSort, 0 },
+};
+
+#define NUM_SORTERS ((int) (sizeof(sorters) / sizeof(sorters[0])))
+
+/* A string length function under test */
+typedef struct {
+    const char *name;
+    size_t (*length)(char *s);
+} measurer_t;
+
+static size_t callStringLength(char *s) { return (size_t) stringLength(s); }
+static size_t callStringLengthFast(char *s) { return (size_t) stringLengthFast(s); }
+static size_t callStrlen(char *s) { return strlen(s); }
+
+static const measurer_t measurers[] = {
+    { "stringLength", callStringLength },
+    { "stringLengthFast", callStringLengthFast },
+    { "strlen", callStrlen },
+};
+
+#define NUM_MEASURERS ((int) (sizeof(measurers) / sizeof(measurers[0])))
+
+/* Globals set by command line args */
+static int max_len = 1 << 16;
+static int max_sort = 1 << 20;
+static int max_quadratic = 1 << 14;
+static int presorted = 0;
+
+#define POOL_INTS (1 << 24)   // random ints the sorts' inputs are cut from: 64 MiB, more than any cache
+
+volatile size_t sink;   // keeps the results, and so the calls, alive
+
+/*
+ * now_ns - monotonic clock in nanoseconds
+ */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/*
+ * rnd - xorshift random numbers, so every run times the same inputs
+ */
+static unsigned rnd(void)
+{
+    static uint64_t state = 0x9E3779B97F4A7C15ull;
+
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (unsigned) (state >> 32);
+}
+
+/*
+ * reps_for - Repetitions that make about 2^24 units of work
+ */
+static long reps_for(long work)
+{
+    long reps = (1L << 24) / (work > 0 ? work : 1);
+
+    return reps > 0 ? reps : 1;
+}
+
+/*
+ * bench_strings - Print the string length table
+ */
+static int bench_strings(void)
+{
+    char *buf = malloc((size_t) max_len + 16);
+    int status = 0;
+
+    printf("%-10s", "len");
+    for (int m = 0; m < NUM_MEASURERS; m++) {
+        printf(" %16s", measurers[m].name);
+    }
+    printf("   (ns/call)\n");
+
+    for (int len = 0; len <= max_len; len = (len == 0) ? 1 : 2 * len) {
+        printf("%-10d", len);
+
+        for (int m = 0; m < NUM_MEASURERS; m++) {
+            long reps = reps_for(len + 16);
+            uint64_t total = 0;
+
+            for (int align = 0; align < 8; align++) { //every start within a word
+                char *s = buf + align;
+                size_t acc = 0;
+
+                memset(s, 'x', (size_t) len);
+                s[len] = '\0';
+
+                uint64_t start = now_ns();
+                for (long r = 0; r < reps; r++) {
+                    acc += measurers[m].length(s);
+                }
+                total += now_ns() - start;
+
+                if (acc != (size_t) len * (size_t) reps) {
+                    printf("\n%s: wrong length at %d+%d\n", measurers[m].name, len, align);
+                    status = -1;
+                }
+                sink = acc;
+            }
+
+            printf(" %16.2f", (double) total / (8.0 * (double) reps));
+        }
+        printf("\n");
+    }
+
+    free(buf);
+    return status;
+}
+
+/*
+ * cmpInt - qsort comparison of two ints, without the overflow of a - b
+ */
+static int cmpInt(const void *a, const void *b)
+{
+    int x = *(const int *) a;
+    int y = *(const int *) b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * bench_sorts - Print the sort table
+ */
+static int bench_sorts(void)
+{
+    size_t pool_ints = (max_sort > POOL_INTS) ? (size_t) max_sort : POOL_INTS;
+    int *pool = malloc(pool_ints * sizeof(int));
+    int *work = malloc((size_t) max_sort * sizeof(int));
+    int *expect = malloc((size_t) max_sort * sizeof(int));
+    int status = 0;
+
+    printf("\n%-10s", "n");
+    for (int t = 0; t < NUM_SORTERS; t++) {
+        printf(" %12s", sorters[t].name);
+    }
+    printf("   (ns/element, %s input)\n", presorted ? "sorted" : "random");
+
+    for (size_t i = 0; i < pool_ints; i++) {
+        pool[i] = (int) rnd();
+    }
+
+    for (int n = 4; n <= max_sort; n *= 2) {
+        long arrays = presorted ? 1 : (long) (pool_ints / (size_t) n);   //distinct inputs, used in turn
+
+        if (presorted) {
+            for (int i = 0; i < n; i++) {
+                pool[i] = i - n / 2;
+            }
+        }
+
+        printf("%-10d", n);
+        for (int t = 0; t < NUM_SORTERS; t++) {
+            if (sorters[t].quadratic && n > max_quadratic) {
+                printf(" %12s", "-");
+                continue;
+            }
+
+            long reps = reps_for(sorters[t].quadratic ? (long) n * n / 4 : 8L * n);
+            uint64_t total = 0;
+            const int *input = pool;
+
+            for (long r = 0; r < reps; r++) {   //a fresh array each time, so no branch history carries over
+                input = pool + (size_t) (r % arrays) * (size_t) n;
+                memcpy(work, input, (size_t) n * sizeof(int));
+                uint64_t start = now_ns();
+                sorters[t].sort(work, n);
+                total += now_ns() - start;
+            }
+
+            memcpy(expect, input, (size_t) n * sizeof(int));   //check the last one
+            qsort(expect, (size_t) n, sizeof(int), cmpInt);
+
+            if (memcmp(work, expect, (size_t) n * sizeof(int)) != 0) {
+                printf("\n%s: wrong order at n=%d\n", sorters[t].name, n);
+                status = -1;
+            }
+            printf(" %12.2f", (double) total / ((double) reps * n));
+        }
+        printf("\n");
+    }
+
+    free(pool);
+    free(work);
+    free(expect);
+    return status;
+}
+
+/*
+ * printUsage - Print usage info
+ */
+static void printUsage(char *argv[])
+{
+    printf("Usage: %s [-hs] [-l <len>] [-n <num>] [-m <num>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h        Print this help message.\n");
+    printf("  -s        Sort already sorted input instead of random.\n");
+    printf("  -l <len>  Longest string timed (default %d).\n", max_len);
+    printf("  -n <num>  Longest array sorted (default %d).\n", max_sort);
+    printf("  -m <num>  Longest array given to selectionSort (default %d).\n", max_quadratic);
+    printf("\nExample:\n");
+    printf("  linux>  %s -n 65536\n", argv[0]);
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char *argv[])
+{
+    int c;
+
+    while ((c = getopt(argc, argv, "hsl:n:m:")) != -1) {
+        switch (c) {
+        case 's':
+            presorted = 1;
+            break;
+        case 'l':
+            max_len = atoi(optarg);
+            break;
+        case 'n':
+            max_sort = atoi(optarg);
+            break;
+        case 'm':
+            max_quadratic = atoi(optarg);
+            break;
+        case 'h':
+            printUsage(argv);
+            exit(0);
+        default:
+            printUsage(argv);
+            exit(1);
+        }
+    }
+
+    if (max_len < 0 || max_sort < 4) {
+        printUsage(argv);
+        exit(1);
+    }
+
+    int status = bench_strings();
+    if (bench_sorts() != 0) {
+        status = -1;
+    }
+    return status != 0;
+}
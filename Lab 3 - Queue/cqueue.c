@@ -0,0 +1,359 @@
+/*
+ * This program implements a lock-free queue of strings that many threads
+ * may insert into and remove from at once.
+ *
+ * It is a Michael-Scott queue: head always points at a dummy element, and
+ * the queue's elements follow it. Inserting CASes the new element onto the
+ * last element's next and then swings tail to it; removing CASes head
+ * forward one element, which makes the first element the new dummy and the
+ * old dummy garbage. A thread that finds tail lagging behind helps move it.
+ *
+ * Memory reclamation uses hazard pointers. Before a thread follows head,
+ * tail or an element's next, it publishes the pointer in one of its hazard
+ * slots and checks that the pointer is still current. A removed dummy is
+ * retired onto the remover's list and only freed once no slot of any thread
+ * holds it. Hazard records are shared by every queue, handed out to threads
+ * on first use and handed back when the thread exits.
+ *
+ * This file doesn't use harness.h: its checked malloc isn't thread safe.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cqueue.h"
+
+#define HAZARDS 2       //hazard slots per thread: an element and its successor
+#define RETIRE_MIN 64   //retired elements a thread keeps before it scans, at least
+
+/* A thread's hazard slots, and the elements it retired */
+typedef struct hp_rec {
+    _Atomic(void *) hazard[HAZARDS];
+    struct hp_rec *next;    //the next record; records are never freed
+    atomic_bool active;     //owned by a thread
+    cq_ele_t **retired;     //removed elements waiting to be freed
+    size_t nretired;
+    size_t cap;
+} hp_rec_t;
+
+static _Atomic(hp_rec_t *) hp_records;  //every record, newest first
+static atomic_int hp_count;             //records in hp_records
+static _Thread_local hp_rec_t *hp_mine; //the calling thread's record
+static pthread_key_t hp_key;            //hands the record back when the thread exits
+static pthread_once_t hp_once = PTHREAD_ONCE_INIT;
+
+static void hp_release(void *rec);
+
+static void hp_init()
+{
+    pthread_key_create(&hp_key, hp_release);
+}
+
+/*
+  Return the calling thread's hazard record, taking an idle one or making
+  one on its first call.
+  Return NULL if could not allocate space.
+*/
+static hp_rec_t *hp_record()
+{
+    if(hp_mine != NULL) {
+      return hp_mine;
+    }
+
+    pthread_once(&hp_once, hp_init);
+
+    hp_rec_t *rec;
+    for(rec = atomic_load(&hp_records); rec != NULL; rec = rec->next) { //reuse the record of a thread that exited
+      bool idle = false;
+      if(atomic_compare_exchange_strong(&rec->active, &idle, true)) {
+        break;
+      }
+    }
+
+    if(rec == NULL) {
+      rec = calloc(1, sizeof(hp_rec_t));
+      if(rec == NULL) {
+        return NULL; //if calloc returned NULL then return NULL
+      }
+      atomic_store(&rec->active, true);
+      rec->next = atomic_load(&hp_records);
+      while(!atomic_compare_exchange_weak(&hp_records, &rec->next, rec)); //push it on the list
+      atomic_fetch_add(&hp_count, 1);
+    }
+
+    hp_mine = rec;
+    pthread_setspecific(hp_key, rec);
+    return rec;
+}
+
+/*
+  Publish the element at *src in hazard slot i, and return it once it is
+  known to still be there (so it can't have been freed)
+*/
+static cq_ele_t *hp_protect(hp_rec_t *rec, int i, _Atomic(cq_ele_t *) *src)
+{
+    cq_ele_t *p = atomic_load(src);
+
+    for(;;) {
+      atomic_store(&rec->hazard[i], p);  //sequentially consistent: ordered before the load below
+      cq_ele_t *again = atomic_load(src);
+      if(again == p) {
+        return p;
+      }
+      p = again;
+    }
+}
+
+static void hp_clear(hp_rec_t *rec)
+{
+    for(int i = 0; i < HAZARDS; i++) {
+      atomic_store_explicit(&rec->hazard[i], NULL, memory_order_release);
+    }
+}
+
+/*
+  Free every element the record retired that no hazard slot holds
+*/
+static void hp_scan(hp_rec_t *rec)
+{
+    size_t kept = 0;
+
+    for(size_t i = 0; i < rec->nretired; i++) {
+      cq_ele_t *e = rec->retired[i];
+      bool hazardous = false;
+
+      for(hp_rec_t *r = atomic_load(&hp_records); r != NULL && !hazardous; r = r->next) {
+        for(int h = 0; h < HAZARDS; h++) {
+          if(atomic_load(&r->hazard[h]) == e) {
+            hazardous = true;
+            break;
+          }
+        }
+      }
+
+      if(hazardous) {
+        rec->retired[kept++] = e; //still being read: try again next scan
+      } else {
+        free(e);
+      }
+    }
+    rec->nretired = kept;
+}
+
+/*
+  Retire an element that was removed, scanning once enough have piled up
+  that most of them can be freed
+*/
+static void hp_retire(hp_rec_t *rec, cq_ele_t *e)
+{
+    if(rec->nretired == rec->cap) {
+      size_t cap = rec->cap ? 2 * rec->cap : RETIRE_MIN;
+      cq_ele_t **retired = realloc(rec->retired, cap * sizeof(cq_ele_t *));
+      if(retired == NULL) {
+        hp_scan(rec); //no room: make some by freeing what we can
+      } else {
+        rec->retired = retired;
+        rec->cap = cap;
+      }
+      if(rec->nretired == rec->cap) {
+        return; //nothing could be freed either; leak e rather than free it unsafely
+      }
+    }
+
+    rec->retired[rec->nretired++] = e;
+
+    size_t threshold = 2 * HAZARDS * (size_t) atomic_load(&hp_count);
+    if(rec->nretired >= (threshold > RETIRE_MIN ? threshold : RETIRE_MIN)) {
+      hp_scan(rec);
+    }
+}
+
+/*
+  Hand a thread's record back as it exits. Its retired elements stay with
+  the record for whichever thread takes it next.
+*/
+static void hp_release(void *arg)
+{
+    hp_rec_t *rec = arg;
+
+    hp_clear(rec);
+    hp_scan(rec);
+    hp_mine = NULL;
+    atomic_store(&rec->active, false);
+}
+
+void cq_reclaim()
+{
+    if(hp_mine != NULL) {
+      hp_scan(hp_mine);
+    }
+}
+
+/*
+  Allocate an element holding a copy of s (or no string, if s is NULL).
+  Return NULL if could not allocate space.
+*/
+static cq_ele_t *cq_ele_new(char *s)
+{
+    size_t len = (s != NULL) ? strlen(s) + 1 : 1;
+    cq_ele_t *e = malloc(sizeof(cq_ele_t) + len);
+
+    if(e == NULL) {
+      return NULL;
+    }
+
+    atomic_init(&e->next, NULL);
+    if(s != NULL) {
+      memcpy(e->value, s, len);
+    } else {
+      e->value[0] = '\0';
+    }
+    return e;
+}
+
+/*
+  Create empty queue.
+  Return NULL if could not allocate space.
+*/
+cqueue_t *cq_new()
+{
+    cqueue_t *q = aligned_alloc(64, sizeof(cqueue_t));
+    cq_ele_t *dummy = cq_ele_new(NULL);
+
+    if(q == NULL || dummy == NULL) {
+      free(q);
+      free(dummy);
+      return NULL;
+    }
+
+    atomic_init(&q->head, dummy);  //head and tail both start at the dummy
+    atomic_init(&q->tail, dummy);
+    atomic_init(&q->removed, 0);
+    atomic_init(&q->inserted, 0);
+    return q;
+}
+
+/* Free all storage used by queue */
+void cq_free(cqueue_t *q)
+{
+    if(q == NULL) {
+      return;
+    }
+
+    cq_ele_t *curr = atomic_load(&q->head);  //the dummy and everything after it
+    while(curr != NULL) {
+      cq_ele_t *currToFree = curr;
+      curr = atomic_load(&curr->next);
+      free(currToFree);
+    }
+
+    free(q);
+}
+
+/*
+  Attempt to insert element at tail of queue.
+  Return true if successful.
+  Return false if q is NULL or could not allocate space.
+ */
+bool cq_insert_tail(cqueue_t *q, char *s)
+{
+    if(q == NULL) {
+      return false;
+    }
+
+    hp_rec_t *rec = hp_record();
+    cq_ele_t *e = cq_ele_new(s);
+    if(rec == NULL || e == NULL) {
+      free(e);
+      return false;
+    }
+
+    for(;;) {
+      cq_ele_t *tail = hp_protect(rec, 0, &q->tail);
+      cq_ele_t *next = atomic_load(&tail->next);
+
+      if(next != NULL) { //tail is lagging: help move it on, then retry
+        atomic_compare_exchange_weak(&q->tail, &tail, next);
+        continue;
+      }
+
+      if(atomic_compare_exchange_weak(&tail->next, &next, e)) { //linked in: this is the insert
+        atomic_compare_exchange_strong(&q->tail, &tail, e); //fails only if someone helped already
+        break;
+      }
+    }
+
+    hp_clear(rec);
+    atomic_fetch_add_explicit(&q->inserted, 1, memory_order_relaxed);
+    return true;
+}
+
+/*
+  Attempt to remove element from head of queue.
+  Return true if successful.
+  Return false if queue is NULL or empty.
+*/
+bool cq_remove_head(cqueue_t *q, char *sp, size_t bufsize)
+{
+    if(q == NULL) {
+      return false;
+    }
+
+    hp_rec_t *rec = hp_record();
+    if(rec == NULL) {
+      return false;
+    }
+
+    cq_ele_t *head;
+    cq_ele_t *next;
+    for(;;) {
+      head = hp_protect(rec, 0, &q->head);
+      next = atomic_load(&head->next);
+      atomic_store(&rec->hazard[1], next);
+      if(atomic_load(&q->head) != head) { //head moved on, so next may already be gone
+        continue;
+      }
+
+      if(next == NULL) { //only the dummy: empty
+        hp_clear(rec);
+        return false;
+      }
+
+      cq_ele_t *tail = atomic_load(&q->tail);
+      if(tail == head) { //tail is lagging behind the element we'd remove: help it first
+        atomic_compare_exchange_weak(&q->tail, &tail, next);
+        continue;
+      }
+
+      if(atomic_compare_exchange_weak(&q->head, &head, next)) { //next is now the dummy, and its string ours
+        break;
+      }
+    }
+
+    if(sp != NULL && bufsize > 0) { //hazard slot 1 still keeps next alive
+      size_t len = strnlen(next->value, bufsize - 1);
+      memcpy(sp, next->value, len);
+      sp[len] = '\0';
+    }
+
+    hp_clear(rec);
+    hp_retire(rec, head);  //the old dummy
+    atomic_fetch_add_explicit(&q->removed, 1, memory_order_relaxed);
+    return true;
+}
+
+/*
+  Return number of elements in queue.
+  Return 0 if q is NULL or empty
+ */
+int cq_size(cqueue_t *q)
+{
+    if(q == NULL) {
+      return 0;
+    }
+
+    unsigned long removed = atomic_load_explicit(&q->removed, memory_order_relaxed);
+    unsigned long inserted = atomic_load_explicit(&q->inserted, memory_order_relaxed);
+    return (inserted > removed) ? (int) (inserted - removed) : 0;
+}
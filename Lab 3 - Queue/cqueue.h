@@ -0,0 +1,82 @@
+/*
+ * A concurrent queue of strings, to go alongside queue_t.
+ *
+ * Any number of threads may insert at the tail and remove from the head at
+ * the same time, without locks. It is a Michael-Scott queue (Michael and
+ * Scott, 1996): a singly-linked list through the elements, headed by a dummy
+ * element, whose head and tail are only ever moved with compare-and-swap.
+ * Removed elements are freed under hazard pointers (Michael, 2004), so a
+ * thread reading an element another thread has just removed never touches
+ * freed memory.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/************** Data structure declarations ****************/
+
+/* Concurrent queue element: the string is stored inline after it */
+typedef struct CQ_ELE {
+    _Atomic(struct CQ_ELE *) next;
+    char value[];
+} cq_ele_t;
+
+/*
+  Concurrent queue structure. Head and tail, which removers and inserters
+  contend on, live on separate cache lines.
+*/
+typedef struct {
+    _Alignas(64) _Atomic(cq_ele_t *) head;  /* the dummy element; the queue starts at head->next */
+    atomic_ulong removed;                   /* elements removed so far */
+    _Alignas(64) _Atomic(cq_ele_t *) tail;  /* the last element, or one just before it */
+    atomic_ulong inserted;                  /* elements inserted so far */
+} cqueue_t;
+
+/************** Operations on concurrent queue ************************/
+
+/*
+  Create empty queue.
+  Return NULL if could not allocate space.
+*/
+cqueue_t *cq_new();
+
+/*
+  Free ALL storage used by queue.
+  No effect if q is NULL
+  No other thread may be using the queue.
+*/
+void cq_free(cqueue_t *q);
+
+/*
+  Attempt to insert element at tail of queue. Safe to call from any
+  number of threads at once.
+  Return true if successful.
+  Return false if q is NULL or could not allocate space.
+  Argument s points to the string to be stored, which is copied.
+ */
+bool cq_insert_tail(cqueue_t *q, char *s);
+
+/*
+  Attempt to remove element from head of queue. Safe to call from any
+  number of threads at once.
+  Return true if successful.
+  Return false if queue is NULL or empty.
+  If sp is non-NULL and an element is removed, copy the removed string to *sp
+  (up to a maximum of bufsize-1 characters, plus a null terminator.)
+*/
+bool cq_remove_head(cqueue_t *q, char *sp, size_t bufsize);
+
+/*
+  Return number of elements in queue.
+  Return 0 if q is NULL or empty
+  While other threads are inserting or removing this is only a snapshot.
+ */
+int cq_size(cqueue_t *q);
+
+/*
+  Free what the calling thread has removed and no thread is still reading.
+  Threads do this on their own as they go and when they exit; call it to
+  give memory back sooner, e.g. after a burst of removes.
+ */
+void cq_reclaim();
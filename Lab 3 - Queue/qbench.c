@@ -0,0 +1,434 @@
+/*
+ * qbench.c - Replays queue lab command traces against queue.c and reports
+ *            per-command throughput and latency percentiles, for each
+ *            queue backend asked for.
+ *
+ * Traces use the qtest command format, one command per line:
+ *
+ *   new               free the current queue, if any, and make a new one
+ *   free              free the current queue
+ *   ih <str> [n]      insert <str> at the head, n times (default once)
+ *   it <str> [n]      insert <str> at the tail, n times
+ *   rh [<str>]        remove the head, checking it is <str> if given
+ *   reverse           reverse the queue
+ *   sort              sort the queue
+ *   size [n]          compute the size, n times
+ *   option <name> <v> ignored: failure injection belongs to the harness
+ *
+ * Blank lines and lines starting with # are skipped, and a queue still
+ * left at the end of a trace is freed, which counts as a free. So does
+ * the q_free of a new on a live queue, in both passes: the new row is
+ * only q_new.
+ *
+ * Every trace is replayed twice with each backend, as in the malloc lab's
+ * mmbench: once timing each command line as a whole for throughput, and
+ * once timing every call for the latency percentiles. Commands that run
+ * once per trace, like reverse and free on trace-13, get a single sample,
+ * so p50 and max are simply that call's time. With -v, each command's
+ * latencies are also printed as a histogram of power-of-two buckets.
+ *
+ * Build (queue.c needs harness.h from the lab handout):
+ *
+ *   gcc -O2 -o qbench qbench.c queue.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "queue.h"
+
+#define MAXSTRING 1024  // longest string rh copies out, as in qtest
+#define HIST_BUCKETS 40 // latency histogram buckets: [2^k, 2^(k+1)) ns each
+
+/* Type of one trace command */
+typedef enum { CMD_NEW, CMD_FREE, CMD_IH, CMD_IT, CMD_RH, CMD_REVERSE, CMD_SORT, CMD_SIZE, NUM_CMDS } cmd_type_t;
+
+static const char *cmd_names[NUM_CMDS] = { "new", "free", "ih", "it", "rh", "reverse", "sort", "size" };
+
+/* One command line from a trace file */
+typedef struct {
+    cmd_type_t type;
+    char *arg;       // string to insert or expect, or NULL
+    size_t reps;     // calls the line makes
+    int line;
+} trace_cmd_t;
+
+/* A whole trace file */
+typedef struct {
+    char *name;
+    trace_cmd_t *cmds;
+    size_t num_cmds;
+} trace_t;
+
+/* Results of replaying one trace with one backend */
+typedef struct {
+    double secs[NUM_CMDS];       // throughput pass, wall clock, by command
+    size_t calls[NUM_CMDS];
+    uint64_t *lat[NUM_CMDS];     // per-call latency in ns, by command
+    size_t num_lat[NUM_CMDS];
+} result_t;
+
+/* Globals set by command line args */
+static int verbosity = 0;
+
+/* Backends that can be benchmarked, by name */
+static const struct {
+    const char *name;
+    q_backend_t backend;
+} backends[] = {
+    { "list", Q_LIST },
+    { "chunked", Q_CHUNKED },
+};
+
+#define NUM_BACKENDS ((int) (sizeof(backends) / sizeof(backends[0])))
+
+/*
+ * now_ns - monotonic clock in nanoseconds
+ */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/*
+ * read_trace - Parse a trace file. Exits on a malformed file.
+ */
+static void read_trace(const char *fn, trace_t *trace)
+{
+    FILE *fp = fopen(fn, "r");
+    char line[MAXSTRING + 64];
+    size_t cap = 64;
+    int lineno = 0;
+
+    if (fp == NULL) {
+        fprintf(stderr, "Error opening trace %s\n", fn);
+        exit(1);
+    }
+
+    trace->name = strdup(fn);
+    trace->cmds = malloc(cap * sizeof(trace_cmd_t));
+    trace->num_cmds = 0;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char name[16];
+        char arg[MAXSTRING + 1];
+        long reps = 1;
+        trace_cmd_t cmd;
+
+        lineno++;
+        int fields = sscanf(line, " %15s %1024s %ld", name, arg, &reps);
+
+        if (fields < 1 || name[0] == '#' || strcmp(name, "option") == 0) { //blank, comment or harness option
+            continue;
+        }
+
+        for (cmd.type = 0; cmd.type < NUM_CMDS; cmd.type++) {
+            if (strcmp(name, cmd_names[cmd.type]) == 0) {
+                break;
+            }
+        }
+        if (cmd.type == NUM_CMDS) {
+            fprintf(stderr, "%s:%d: unknown command: %s", fn, lineno, line);
+            exit(1);
+        }
+
+        cmd.arg = NULL;
+        cmd.reps = 1;
+        cmd.line = lineno;
+        if (cmd.type == CMD_IH || cmd.type == CMD_IT) {
+            if (fields < 2 || reps < 1) {
+                fprintf(stderr, "%s:%d: bad insert: %s", fn, lineno, line);
+                exit(1);
+            }
+            cmd.arg = strdup(arg);
+            cmd.reps = (size_t) reps;
+        } else if (cmd.type == CMD_RH && fields >= 2) {
+            cmd.arg = strdup(arg);
+        } else if (cmd.type == CMD_SIZE && fields >= 2) {
+            cmd.reps = (size_t) atol(arg);
+        }
+
+        if (trace->num_cmds == cap) {
+            cap *= 2;
+            trace->cmds = realloc(trace->cmds, cap * sizeof(trace_cmd_t));
+        }
+        trace->cmds[trace->num_cmds++] = cmd;
+    }
+
+    fclose(fp);
+}
+
+/*
+ * replay - Run every command of a trace against a fresh queue of the
+ *          given backend. If lat is set, each call is timed and recorded
+ *          in res; otherwise each command line is timed as a whole.
+ *          Returns 0 on success, -1 if a call on a live queue failed.
+ */
+static int replay(const trace_t *trace, q_backend_t backend, result_t *res, int lat)
+{
+    queue_t *q = NULL;
+    char buf[MAXSTRING];
+    int status = 0;
+
+    for (size_t i = 0; i < trace->num_cmds || q != NULL; i++) {
+        trace_cmd_t end = { CMD_FREE, NULL, 1, 0 };   //the implicit free at the end of the trace
+        const trace_cmd_t *cmd = (i < trace->num_cmds) ? &trace->cmds[i] : &end;
+        uint64_t *rec = lat ? res->lat[cmd->type] + res->num_lat[cmd->type] : NULL;
+        uint64_t start = now_ns();
+        uint64_t t = start;
+        uint64_t freed = 0;   //ns spent in the q_free of a new, which counts as a free
+        int ok = 1;
+
+        for (size_t r = 0; r < cmd->reps && ok; r++) {
+            switch (cmd->type) {
+            case CMD_NEW:
+                if (q != NULL) {
+                    uint64_t f = now_ns();
+                    q_free(q);
+                    uint64_t done = now_ns();
+
+                    if (lat) {
+                        res->lat[CMD_FREE][res->num_lat[CMD_FREE]++] = done - f;
+                    } else {
+                        res->secs[CMD_FREE] += (double) (done - f) / 1e9;
+                        res->calls[CMD_FREE]++;
+                    }
+                    freed += done - f;
+                    t = done;
+                }
+                q = q_new_backend(backend);
+                ok = (q != NULL);
+                break;
+            case CMD_FREE:
+                q_free(q);
+                q = NULL;
+                break;
+            case CMD_IH:
+                ok = q_insert_head(q, cmd->arg) || q == NULL;
+                break;
+            case CMD_IT:
+                ok = q_insert_tail(q, cmd->arg) || q == NULL;
+                break;
+            case CMD_RH:
+                if (q_remove_head(q, buf, sizeof(buf)) && cmd->arg != NULL && strcmp(buf, cmd->arg) != 0) {
+                    fprintf(stderr, "%s:%d: removed %s, expected %s\n", trace->name, cmd->line, buf, cmd->arg);
+                    status = -1;
+                }
+                break;
+            case CMD_REVERSE:
+                q_reverse(q);
+                break;
+            case CMD_SORT:
+                q_sort(q);
+                break;
+            case CMD_SIZE:
+                (void) q_size(q);
+                break;
+            default:
+                break;
+            }
+
+            if (lat) {
+                uint64_t done = now_ns();
+                *rec++ = done - t;
+                t = done;
+            }
+        }
+
+        if (lat) {
+            res->num_lat[cmd->type] = (size_t) (rec - res->lat[cmd->type]);
+        } else {
+            res->secs[cmd->type] += (double) (now_ns() - start - freed) / 1e9;
+            res->calls[cmd->type] += cmd->reps;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "%s:%d: %s failed\n", trace->name, cmd->line, cmd_names[cmd->type]);
+            q_free(q);
+            return -1;
+        }
+    }
+
+    return status;
+}
+
+/*
+ * cmp_u64 - qsort comparator for latencies
+ */
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * percentile - the p-th percentile of n sorted latencies
+ */
+static uint64_t percentile(const uint64_t *lat, size_t n, double p)
+{
+    size_t i = (size_t) (p / 100.0 * (double) (n - 1) + 0.5);
+
+    return lat[i];
+}
+
+/*
+ * run_trace - Benchmark one backend on one trace and print the results.
+ *             Returns -1 if a command failed.
+ */
+static int run_trace(const trace_t *trace, int b)
+{
+    result_t res;
+    size_t counts[NUM_CMDS] = { 0 };
+
+    memset(&res, 0, sizeof(res));
+    for (size_t i = 0; i < trace->num_cmds; i++) {
+        counts[trace->cmds[i].type] += trace->cmds[i].reps;
+    }
+    counts[CMD_FREE] += counts[CMD_NEW] + 1;   //a new may free the queue before it, and the implicit free at the end
+    for (int t = 0; t < NUM_CMDS; t++) {
+        res.lat[t] = malloc((counts[t] + 1) * sizeof(uint64_t));
+    }
+
+    /* Throughput pass, then latency pass */
+    int status = replay(trace, backends[b].backend, &res, 0);
+    if (status == 0) {
+        status = replay(trace, backends[b].backend, &res, 1);
+    }
+
+    double total = 0;
+    for (int t = 0; t < NUM_CMDS; t++) {
+        total += res.secs[t];
+    }
+    printf("%-32s %-8s %10.6f s\n", trace->name, backends[b].name, total);
+
+    for (int t = 0; status == 0 && t < NUM_CMDS; t++) {
+        size_t n = res.num_lat[t];
+
+        if (n == 0) {
+            continue;
+        }
+        qsort(res.lat[t], n, sizeof(uint64_t), cmp_u64);
+        printf("  %-8s n=%-9zu %12.0f ops/s  p50 %9llu ns  p99 %9llu ns  max %10llu ns\n",
+               cmd_names[t], n,
+               (double) res.calls[t] / (res.secs[t] > 0 ? res.secs[t] : 1e-9),
+               (unsigned long long) percentile(res.lat[t], n, 50),
+               (unsigned long long) percentile(res.lat[t], n, 99),
+               (unsigned long long) res.lat[t][n - 1]);
+
+        if (verbosity) {
+            size_t hist[HIST_BUCKETS] = { 0 };
+
+            for (size_t i = 0; i < n; i++) {
+                int k = 0;
+                while (k < HIST_BUCKETS - 1 && (res.lat[t][i] >> (k + 1)) != 0) {
+                    k++;
+                }
+                hist[k]++;
+            }
+            for (int k = 0; k < HIST_BUCKETS; k++) {
+                if (hist[k] != 0) {
+                    printf("    < %12llu ns %10zu\n", 1ull << (k + 1), hist[k]);
+                }
+            }
+        }
+    }
+
+    for (int t = 0; t < NUM_CMDS; t++) {
+        free(res.lat[t]);
+    }
+    return status;
+}
+
+/*
+ * printUsage - Print usage info
+ */
+static void printUsage(char *argv[])
+{
+    printf("Usage: %s [-hv] [-b <backend>]... <trace>...\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h            Print this help message.\n");
+    printf("  -b <backend>  Queue backend: list, chunked or all. Repeat to\n");
+    printf("                compare several; the default is list.\n");
+    printf("  -v            Print a latency histogram for each command.\n");
+    printf("\nExample:\n");
+    printf("  linux>  %s -b all traces/trace-13-perf*.cmd\n", argv[0]);
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char *argv[])
+{
+    int use[NUM_BACKENDS] = { 0 };
+    int any = 0;
+    int status = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "hvb:")) != -1) {
+        switch (c) {
+        case 'b': {
+            int found = 0;
+            for (int b = 0; b < NUM_BACKENDS; b++) {
+                if (strcmp(optarg, "all") == 0 || strcmp(optarg, backends[b].name) == 0) {
+                    use[b] = 1;
+                    found = 1;
+                }
+            }
+            if (!found) {
+                printUsage(argv);
+                exit(1);
+            }
+            any = 1;
+            break;
+        }
+        case 'v':
+            verbosity = 1;
+            break;
+        case 'h':
+            printUsage(argv);
+            exit(0);
+        default:
+            printUsage(argv);
+            exit(1);
+        }
+    }
+
+    if (optind == argc) {
+        printf("%s: Missing trace file\n", argv[0]);
+        printUsage(argv);
+        exit(1);
+    }
+    if (!any) {
+        use[0] = 1;
+    }
+
+    for (int i = optind; i < argc; i++) {
+        trace_t trace;
+
+        read_trace(argv[i], &trace);
+
+        for (int b = 0; b < NUM_BACKENDS; b++) {
+            if (use[b] && run_trace(&trace, b) != 0) {
+                status = 1;
+            }
+        }
+
+        for (size_t j = 0; j < trace.num_cmds; j++) {
+            free(trace.cmds[j].arg);
+        }
+        free(trace.cmds);
+        free(trace.name);
+    }
+
+    return status;
+}
@@ -7,21 +7,482 @@
  * This program implements a queue supporting both FIFO and LIFO
  * operations.
  *
- * It uses a singly-linked list to represent the set of queue elements
+ * It uses a singly-linked list to represent the set of queue elements.
+ * Each element is a single block with its string stored inline after it.
+ *
+ * The blocks come from slabs the queue allocates, starting small and
+ * doubling up to SLAB_MAX bytes. A removed element goes on a free list for
+ * its size class, and the next insert of that class reuses it, so most
+ * inserts don't call malloc at all. The slabs are only returned by q_free,
+ * which frees them whole. An element too big for the largest class gets a
+ * block of its own instead, of its exact size, on a doubly-linked list so
+ * it can be freed as soon as it is removed; it has no effect on the size
+ * of the slabs.
+ *
+ * An element can also hold a string that was not copied in, adopted from
+ * the caller: its value then points outside it, at a block of the caller's
+ * that the queue frees (or hands back) when the element is removed. Such
+ * an element doesn't use its inline storage, so that holds the links of a
+ * circular doubly-linked list of the queue's adopted elements, which lets
+ * q_free free their strings without walking the queue, and q_concat hand
+ * them over in one splice.
+ *
+ * A chunked queue (Q_CHUNKED) keeps pointers to the same elements, not
+ * linked through next, in a doubly-linked deque of chunks. Inserting at
+ * either end fills the end chunk, adding a chunk when it is full, and
+ * removing empties it. Reversing only flips which physical end is the
+ * head.
+ *
+ * q_sort is a bottom-up merge sort that relinks the elements through next.
+ * It compares the first KEY_BYTES bytes of two strings as one number, and
+ * only calls strcmp when those are equal.
  */
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 
 #include "harness.h"
 #include "queue.h"
 
+#define ELE_MIN (sizeof(list_ele_t) + Q_INLINE)  //size of class 0, elements holding short strings
+#define SLAB_MIN 1024          //bytes of element storage in a queue's first slab
+#define SLAB_MAX (1 << 20)     //most bytes in a slab, unless one element needs more
+#define KEY_BYTES 8            //bytes of each string q_sort compares as one number
+#define SORT_LEVELS 32         //runs q_sort can have pending: one per bit of the size
+
+struct q_slab {
+    struct q_slab *next;  //the next older slab
+    size_t size;          //bytes in mem
+    size_t used;          //bytes of mem handed out so far
+    char mem[];
+};
+
+struct q_large {
+    struct q_large *prev;
+    struct q_large *next;
+    char mem[];           //the element
+};
+
+/* Links of an adopted element in its queue's ring, kept in its data */
+struct q_adopted {
+    list_ele_t *prev;
+    list_ele_t *next;
+};
+
+_Static_assert(sizeof(struct q_adopted) <= Q_INLINE, "an adopted element's links must fit in its inline storage");
+
+#define ADOPTED(e) ((struct q_adopted *) (e)->data)
+
+/*
+  Return the size class of an element holding a string of len bytes,
+  terminator included, or -1 if it is too long for any class (and so
+  needs a block of its own)
+*/
+static int ele_class(size_t len)
+{
+    size_t size = sizeof(list_ele_t) + (len < Q_INLINE ? Q_INLINE : len);
+    int k = 0;
+
+    while(k < Q_CLASSES && (ELE_MIN << k) < size) {
+      k++;  //find the smallest class the element fits in
+    }
+    return (k < Q_CLASSES) ? k : -1;
+}
+
+/*
+  Allocate an element of class k, reusing a removed one if there is one,
+  else carving it from the newest slab (and adding a slab if that is full).
+  Return NULL if could not allocate space.
+*/
+static list_ele_t *ele_alloc(queue_t *q, int k)
+{
+    size_t size = ELE_MIN << k;
+    struct q_slab *slab = q->slabs;
+
+    if(q->free_ele[k] != NULL) {
+      list_ele_t *e = q->free_ele[k];  //pop it off its class's free list
+      q->free_ele[k] = e->next;
+      return e;
+    }
+
+    if(slab == NULL || slab->size - slab->used < size) {
+      size_t slab_size = (slab == NULL) ? SLAB_MIN : (slab->size < SLAB_MAX ? 2 * slab->size : slab->size);
+      while(slab_size < size) {
+        slab_size *= 2;  //keep doubling, to at most SLAB_MAX: no class is bigger than that
+      }
+
+      slab = malloc(sizeof(struct q_slab) + slab_size);
+      if(slab == NULL) {
+        return NULL;  //if malloc returned NULL then return NULL
+      }
+      slab->next = q->slabs;
+      slab->size = slab_size;
+      slab->used = 0;
+      if(q->slabs == NULL) {
+        q->oldest_slab = slab;  //the first slab stays the oldest
+      }
+      q->slabs = slab;
+    }
+
+    list_ele_t *e = (list_ele_t *) (slab->mem + slab->used);
+    slab->used += size;
+    return e;
+}
+
+/*
+  Allocate a block of its own for an element holding a string of len
+  bytes, too long for any class.
+  Return NULL if could not allocate space.
+*/
+static list_ele_t *ele_large(queue_t *q, size_t len)
+{
+    struct q_large *b = malloc(sizeof(struct q_large) + sizeof(list_ele_t) + len);
+
+    if(b == NULL) {
+      return NULL;
+    }
+
+    b->prev = NULL;  //push it on q's list of large blocks
+    b->next = q->large;
+    if(q->large != NULL) {
+      q->large->prev = b;
+    } else {
+      q->large_last = b;
+    }
+    q->large = b;
+    return (list_ele_t *) b->mem;
+}
+
+/*
+  Free the block of an element from ele_large
+*/
+static void ele_large_free(queue_t *q, list_ele_t *e)
+{
+    struct q_large *b = (struct q_large *) ((char *) e - offsetof(struct q_large, mem));
+
+    if(b->prev != NULL) {
+      b->prev->next = b->next;
+    } else {
+      q->large = b->next;
+    }
+    if(b->next != NULL) {
+      b->next->prev = b->prev;
+    } else {
+      q->large_last = b->prev;
+    }
+    free(b);
+}
+
+/*
+  Allocate an element of q holding a copy of s.
+  Return NULL if could not allocate space.
+*/
+static list_ele_t *ele_new(queue_t *q, char *s)
+{
+    size_t len = strlen(s) + 1;  //bytes of the string, with its terminator
+    int k = ele_class(len);
+    list_ele_t *e = (k < 0) ? ele_large(q, len) : ele_alloc(q, k);
+
+    if(e == NULL) {
+      return NULL;  //if there was no space then return NULL
+    }
+
+    memcpy(e->data, s, len);  //copy s, terminator included, into the element
+    e->value = e->data;
+    return e;
+}
+
+/*
+  Allocate an element of q holding s itself, which q takes ownership of.
+  Return NULL if could not allocate space.
+*/
+static list_ele_t *ele_adopt(queue_t *q, char *s)
+{
+    list_ele_t *e = ele_alloc(q, 0);  //no string to fit: the smallest class
+
+    if(e == NULL) {
+      return NULL;
+    }
+
+    e->value = s;
+
+    if(q->adopted == NULL) { //link it in at the end of q's ring of adopted elements
+      ADOPTED(e)->prev = e;
+      ADOPTED(e)->next = e;
+      q->adopted = e;
+    } else {
+      list_ele_t *last = ADOPTED(q->adopted)->prev;
+      ADOPTED(e)->prev = last;
+      ADOPTED(e)->next = q->adopted;
+      ADOPTED(last)->next = e;
+      ADOPTED(q->adopted)->prev = e;
+    }
+    return e;
+}
+
+/*
+  Unlink an adopted element from q's ring of them
+*/
+static void ele_unadopt(queue_t *q, list_ele_t *e)
+{
+    list_ele_t *prev = ADOPTED(e)->prev;
+    list_ele_t *next = ADOPTED(e)->next;
+
+    if(next == e) {
+      q->adopted = NULL;  //it was the only one
+      return;
+    }
+    ADOPTED(prev)->next = next;
+    ADOPTED(next)->prev = prev;
+    if(q->adopted == e) {
+      q->adopted = next;
+    }
+}
+
+/*
+  Put an element of q that was unlinked on the free list of its class,
+  or free it if it has a block of its own.
+  An adopted string is freed with it, unless keep is set.
+*/
+static void ele_release(queue_t *q, list_ele_t *e, bool keep)
+{
+    int k = 0;
+
+    if(e->value != e->data) { //adopted: its string is a block of its own
+      if(!keep) {
+        free(e->value);
+      }
+      ele_unadopt(q, e);
+    } else {
+      k = ele_class(strlen(e->value) + 1);
+      if(k < 0) {
+        ele_large_free(q, e);
+        return;
+      }
+    }
+
+    e->next = q->free_ele[k];
+    q->free_ele[k] = e;
+}
+
+/*
+  Get a chunk for q, the spare one if there is one.
+  Return NULL if could not allocate space.
+*/
+static struct q_chunk *chunk_new(queue_t *q)
+{
+    struct q_chunk *c = q->spare;
+
+    if(c != NULL) {
+      q->spare = NULL;
+      return c;
+    }
+    return malloc(sizeof(struct q_chunk));
+}
+
+/*
+  Give back a chunk of q that was emptied, keeping one spare so a queue
+  hovering at a chunk boundary doesn't allocate on every insert
+*/
+static void chunk_free(queue_t *q, struct q_chunk *c)
+{
+    if(q->spare == NULL) {
+      q->spare = c;
+    } else {
+      free(c);
+    }
+}
+
+/*
+  Add an element at the physical front (or back) of a chunked queue.
+  Return false if could not allocate space.
+*/
+static bool chunk_push(queue_t *q, list_ele_t *e, bool front)
+{
+    if(front) {
+      if(q->first == NULL || q->first_pos == 0) { //no room before the first element: add a chunk
+        struct q_chunk *c = chunk_new(q);
+        if(c == NULL) {
+          return false;
+        }
+        c->prev = NULL;
+        c->next = q->first;
+        if(q->first != NULL) {
+          q->first->prev = c;
+        } else {
+          q->last = c;  //the only chunk, and empty
+          q->last_pos = Q_CHUNK;
+        }
+        q->first = c;
+        q->first_pos = Q_CHUNK;
+      }
+      q->first->ele[--q->first_pos] = e;
+    } else {
+      if(q->last == NULL || q->last_pos == Q_CHUNK) { //no room after the last element: add a chunk
+        struct q_chunk *c = chunk_new(q);
+        if(c == NULL) {
+          return false;
+        }
+        c->next = NULL;
+        c->prev = q->last;
+        if(q->last != NULL) {
+          q->last->next = c;
+        } else {
+          q->first = c;  //the only chunk, and empty
+          q->first_pos = 0;
+        }
+        q->last = c;
+        q->last_pos = 0;
+      }
+      q->last->ele[q->last_pos++] = e;
+    }
+    return true;
+}
+
+/*
+  Remove and return the element at the physical front (or back) of a
+  chunked queue, which must not be empty
+*/
+static list_ele_t *chunk_pop(queue_t *q, bool front)
+{
+    list_ele_t *e = front ? q->first->ele[q->first_pos++] : q->last->ele[--q->last_pos];
+
+    if(q->first == q->last && q->first_pos == q->last_pos) { //that was the last element
+      chunk_free(q, q->first);
+      q->first = NULL;
+      q->last = NULL;
+    } else if(front && q->first_pos == Q_CHUNK) { //the first chunk is empty
+      struct q_chunk *c = q->first;
+      q->first = c->next;
+      q->first->prev = NULL;
+      q->first_pos = 0;
+      chunk_free(q, c);
+    } else if(!front && q->last_pos == 0) { //the last chunk is empty
+      struct q_chunk *c = q->last;
+      q->last = c->prev;
+      q->last->next = NULL;
+      q->last_pos = Q_CHUNK;
+      chunk_free(q, c);
+    }
+    return e;
+}
+
+/*
+  Link a new element in at the head of q.
+  Return false if could not allocate space, leaving e unlinked.
+*/
+static bool ele_push_head(queue_t *q, list_ele_t *e)
+{
+    if(q->backend == Q_CHUNKED) { //the head is the physical front, unless reversed
+      if(!chunk_push(q, e, !q->reversed)) {
+        return false;
+      }
+      q->size += 1;
+      return true;
+    }
+
+    e->next = q->head;  //set the new list element's next value to the head of current queue so list element is now at front
+    q->head = e;       //set head of queue to new list element
+
+    if(q->size == 0) {
+      q->tail = e; //if this is the first element, then it is the head and tail
+    }
+
+    q->size += 1;    //increment the queue's size counter
+
+    return true;
+}
+
+/*
+  Link a new element in at the tail of q.
+  Return false if could not allocate space, leaving e unlinked.
+*/
+static bool ele_push_tail(queue_t *q, list_ele_t *e)
+{
+    if(q->backend == Q_CHUNKED) { //the tail is the physical back, unless reversed
+      if(!chunk_push(q, e, q->reversed)) {
+        return false;
+      }
+      q->size += 1;
+      return true;
+    }
+
+    e->next = NULL; //set the new tail element's next to null
+
+    if(q->size == 0) { //if the queue is empty
+      q->head = e;  //set the new list element to the head and the tail
+    } else {
+      q->tail->next = e; //set the queue's current tail's next field to the new tail
+    }
+    q->tail = e;  //set the new list element to the tail
+    q->size += 1;    //increment the queue's size
+
+    return true;
+}
+
+/*
+  Return the head element of q, which must not be empty, without unlinking it
+*/
+static list_ele_t *ele_peek_head(queue_t *q)
+{
+    if(q->backend == Q_CHUNKED) {
+      return q->reversed ? q->last->ele[q->last_pos - 1] : q->first->ele[q->first_pos];
+    }
+    return q->head;
+}
+
+/*
+  Unlink and return the head element of q, which must not be empty
+*/
+static list_ele_t *ele_pop_head(queue_t *q)
+{
+    list_ele_t *e;
+
+    if(q->backend == Q_CHUNKED) {
+      e = chunk_pop(q, !q->reversed);
+    } else {
+      e = q->head;
+      q->head = e->next; //set the new head equal to the current head's next
+      if(q->head == NULL) {
+        q->tail = NULL;  //that was the only element: the queue is empty
+      }
+    }
+
+    q->size -= 1;   //decrement size because a list element was removed
+    return e;
+}
+
+/*
+  Copy the string of e to *sp, up to a maximum of bufsize-1 characters,
+  plus a null terminator
+*/
+static void ele_copy_out(list_ele_t *e, char *sp, size_t bufsize)
+{
+    if(sp == NULL || bufsize == 0) {
+      return;
+    }
+
+    size_t len = strnlen(e->value, bufsize - 1);  //stop at the string's end, or when sp is full
+    memcpy(sp, e->value, len);
+    sp[len] = '\0';
+}
+
 /*
   Create empty queue.
   Return NULL if could not allocate space.
 */
 queue_t *q_new()
+{
+    return q_new_backend(Q_LIST);
+}
+
+/*
+  Create empty queue that keeps its elements with the given backend.
+  Return NULL if could not allocate space.
+*/
+queue_t *q_new_backend(q_backend_t backend)
 {
     queue_t *q =  malloc(sizeof(queue_t));
     if(q == NULL) {
@@ -31,6 +492,21 @@ queue_t *q_new()
     q->head = NULL;  //sets head and tail to null, and sets initial size to 0
     q->tail = NULL;
     q->size = 0;
+    q->slabs = NULL;  //no element storage yet
+    q->oldest_slab = NULL;
+    q->large = NULL;
+    q->large_last = NULL;
+    for(int k = 0; k < Q_CLASSES; k++) {
+      q->free_ele[k] = NULL;
+    }
+    q->backend = backend;
+    q->first = NULL;  //no chunks yet either
+    q->last = NULL;
+    q->first_pos = 0;
+    q->last_pos = 0;
+    q->reversed = false;
+    q->spare = NULL;
+    q->adopted = NULL;
 
     return q;
 }
@@ -42,17 +518,38 @@ void q_free(queue_t *q)
       return;
     }
 
-    list_ele_t *curr = q->head;  //set curr equal to q's head
-    list_ele_t *currToFree = NULL;  //initialize currToFree to NUll - will be used ad a temp
+    if(q->adopted != NULL) { //adopted strings are the only storage outside the slabs
+      list_ele_t *e = q->adopted;
+      do {
+        free(e->value);
+        e = ADOPTED(e)->next;
+      } while(e != q->adopted);
+    }
+
+    struct q_slab *curr = q->slabs;  //set curr equal to q's newest slab
+    struct q_slab *currToFree = NULL;  //initialize currToFree to NUll - will be used ad a temp
 
     while(curr != NULL) {
-      currToFree = curr; //set temp list element fo be freed
+      currToFree = curr; //set temp slab to be freed
+
+      curr = curr->next; //go to the next older slab
 
-      curr = curr->next; //go to next list element in the queue
+      free(currToFree);  //free the slab, and every list element in it
+    }
+
+    while(q->large != NULL) { //and the elements too big for a slab
+      struct q_large *b = q->large;
+      q->large = b->next;
+      free(b);
+    }
 
-      free(currToFree->value); //free the string
-      free(currToFree);  //free the list element
+    struct q_chunk *chunk = q->first;  //free the chunks of a chunked queue, in order
+    while(chunk != NULL) {
+      struct q_chunk *chunkToFree = chunk;
+      chunk = chunk->next;
+      free(chunkToFree);
     }
+    free(q->spare);
 
     /* Free queue structure */
     free(q);
@@ -74,30 +571,17 @@ bool q_insert_head(queue_t *q, char *s)
       return false;
     }
 
-    list_ele_t *newh = malloc(sizeof(list_ele_t));  //allocate space for the new list element
+    list_ele_t *newh = ele_new(q, s);  //allocate the new list element, with a copy of s
 
     if(newh == NULL){ //if call to malloc returned NULL, then return false
       return false;
     }
 
-    newh->value = malloc(strlen(s) + 1);            //allocate space for the new list element's value
-
-    if(newh->value == NULL) { //if call to malloc returned NULL, then return false
-      free(newh);              //also you need to free the space allocated for the list element
+    if(!ele_push_head(q, newh)) {
+      ele_release(q, newh, false);
       return false;
     }
 
-    strcpy(newh->value, s); //copy s into the new list element's value
-
-    newh->next = q->head;  //set the new list element's next value to the head of current queue so list element is now at front
-    q->head = newh;       //set head of queue to new list element
-
-    if(q->size == 0) {
-      q->tail = newh; //if this is the first element, then it is the head and tail
-    }
-
-    q->size += 1;    //increment the queue's size counter
-
     return true;
 }
 
@@ -118,37 +602,94 @@ bool q_insert_tail(queue_t *q, char *s)
       return false;
     }
 
-    list_ele_t *newtail = malloc(sizeof(list_ele_t));  //allocate space for the new list element
+    list_ele_t *newtail = ele_new(q, s);  //allocate the new list element, with a copy of s
 
     if(newtail == NULL){ //if call to malloc returned NULL, then return false
       return false;
     }
 
-    newtail->value = malloc(strlen(s) + 1);            //allocate space for the new list element's value
+    if(!ele_push_tail(q, newtail)) {
+      ele_release(q, newtail, false);
+      return false;
+    }
+
+    return true;
+}
 
-    if(newtail->value == NULL) { //if call to malloc returned NULL, then return false
-      free(newtail);             //also you need to free the space allocated for the list element
+/*
+  Attempt to insert element at head of queue, without copying the string.
+  Return true if successful, and q then owns s.
+  Return false if q is NULL or could not allocate space; s is still the caller's.
+ */
+bool q_insert_head_adopt(queue_t *q, char *s)
+{
+    if(q == NULL || s == NULL) {
       return false;
     }
 
-    strcpy(newtail->value, s); //copy s into the new list element's value
-    newtail->next = NULL; //set the new tail element's next to null
+    list_ele_t *newh = ele_adopt(q, s);
 
-    if(q->size == 0) { //if the queue is empty
-      q->head = newtail;  //set the new list element to the head and the tail
-      q->tail = newtail;
-      q->size += 1;   //increment the queue's size
-      return true;
+    if(newh == NULL) {
+      return false;
     }
 
-    if(q->size > 0) {
-      q->tail->next = newtail; //set the queue's current tail's next field to the new tail
-      q->tail = newtail;  //set the new list element to the tail
-      q->size += 1;    //increment the queue's size
-      return true;
+    if(!ele_push_head(q, newh)) {
+      ele_release(q, newh, true);  //give s back to the caller
+      return false;
     }
 
-    return false;
+    return true;
+}
+
+/*
+  Attempt to insert element at tail of queue, without copying the string.
+  Return true if successful, and q then owns s.
+  Return false if q is NULL or could not allocate space; s is still the caller's.
+ */
+bool q_insert_tail_adopt(queue_t *q, char *s)
+{
+    if(q == NULL || s == NULL) {
+      return false;
+    }
+
+    list_ele_t *newtail = ele_adopt(q, s);
+
+    if(newtail == NULL) {
+      return false;
+    }
+
+    if(!ele_push_tail(q, newtail)) {
+      ele_release(q, newtail, true);  //give s back to the caller
+      return false;
+    }
+
+    return true;
+}
+
+/*
+  Attempt to insert n elements at tail of queue, sv[0] first.
+  Return the number inserted, which is less than n only if space ran out.
+ */
+int q_insert_tail_n(queue_t *q, char **sv, int n)
+{
+    if(q == NULL) {
+      return 0;
+    }
+
+    int i;
+    for(i = 0; i < n; i++) {
+      list_ele_t *newtail = ele_new(q, sv[i]);
+
+      if(newtail == NULL) {
+        break;
+      }
+      if(!ele_push_tail(q, newtail)) {
+        ele_release(q, newtail, false);
+        break;
+      }
+    }
+
+    return i;
 }
 
 /*
@@ -161,36 +702,65 @@ bool q_insert_tail(queue_t *q, char *s)
 */
 bool q_remove_head(queue_t *q, char *sp, size_t bufsize)
 {
-    if(q == NULL || q->size == 0 || sp == NULL) { //if current queue is null, return false   OR if the current queue is empty, then there is no head to remove
+    if(q == NULL || q->size == 0) { //if current queue is null, return false   OR if the current queue is empty, then there is no head to remove
       return false;
     }
 
-    char *removedString = q->head->value;  //removed string
+    list_ele_t *currToRemove = ele_pop_head(q);   //unlink the queue's head
+
+    ele_copy_out(currToRemove, sp, bufsize);  //copy the removed string to sp, if there is an sp
 
-    while(bufsize - 1 > 0) { //up to a maximum of bufsize-1 characters
-      *sp = *removedString;  //copying the removed string to sp - this starts at the first character in the removed string
+    ele_release(q, currToRemove, false); //recycle the list element and its string
 
-      sp += 1;               //moves sp to the next character in the string
-      removedString += 1;    //moves removedString to the next character in the string
+    return true;
+}
 
-      bufsize -=1;  //decrement bufsize
+/*
+  Attempt to remove element from head of queue, handing back its string.
+  Return the string, which the caller must free, or NULL if queue is NULL,
+  empty, or could not allocate space (the element is then left in place).
+*/
+char *q_remove_head_take(queue_t *q)
+{
+    if(q == NULL || q->size == 0) {
+      return NULL;
     }
 
-    *sp = '\0';  //if at the end, add a null terminator character
+    list_ele_t *head = ele_peek_head(q);
+    char *s = head->value;
 
-    list_ele_t *currToRemove = q->head;   //initialize the list element to be removed to the queue's head
+    if(s == head->data) { //stored inline: the caller gets a block of its own
+      size_t len = strlen(s) + 1;
+      s = malloc(len);
+      if(s == NULL) {
+        return NULL;
+      }
+      memcpy(s, head->data, len);
+    }
 
-    q->head = q->head->next; //set the new head equal to the current head's next
-    q->size -=1;   //decrement size because a list element was removed
+    ele_release(q, ele_pop_head(q), true);  //an adopted string goes to the caller as it is
+    return s;
+}
 
-    if(q->size == 1) {
-      q->tail = NULL;     //if the element to be removed is the only one, then the new tail will be null
+/*
+  Attempt to remove up to n elements from head of queue.
+  Return the number removed: n, or fewer if the queue ran out first.
+*/
+int q_remove_head_n(queue_t *q, char *sp, size_t bufsize, int n)
+{
+    if(q == NULL) {
+      return 0;
     }
 
-    free(currToRemove->value);  //free the string
-    free(currToRemove); //free the list element
+    int i;
+    for(i = 0; i < n && q->size > 0; i++) {
+      list_ele_t *currToRemove = ele_pop_head(q);
 
-    return true;
+      ele_copy_out(currToRemove, (sp != NULL) ? sp + (size_t) i * bufsize : NULL, bufsize);
+      ele_release(q, currToRemove, false);
+    }
+
+    return i;
 }
 
 /*
@@ -220,6 +790,11 @@ void q_reverse(queue_t *q)
     return;
   }
 
+  if(q->backend == Q_CHUNKED) {
+    q->reversed = !q->reversed;  //the head becomes the other end of the chunks
+    return;
+  }
+
   list_ele_t *previousElement = NULL;  //set a previous element holder and initialize it to NULL because in the first iteration of the while loop, the head's next will be set to NULL
   list_ele_t *curr = q->head;          //set a curr list element initialized to the head of the queue
   list_ele_t *nextElement = q->head->next; //set a nextElement list element initialized to the head's next field
@@ -237,3 +812,257 @@ void q_reverse(queue_t *q)
 
   q->head = curr;  //set curr to the head
 }
+
+/*
+  Return the first KEY_BYTES bytes of s, zero-padded past its terminator,
+  as a number: keys that differ order their strings as strcmp does
+*/
+static unsigned long long ele_key(const char *s)
+{
+    unsigned long long key = 0;
+    int i = 0;
+
+    for(; i < KEY_BYTES && s[i] != '\0'; i++) {
+      key = (key << 8) | (unsigned char) s[i];
+    }
+    for(; i < KEY_BYTES; i++) {
+      key <<= 8;
+    }
+    return key;
+}
+
+/*
+  Compare two elements, given their keys, as strcmp compares their strings
+*/
+static int ele_cmp(list_ele_t *a, unsigned long long ka, list_ele_t *b, unsigned long long kb)
+{
+    if(ka != kb) {
+      return (ka < kb) ? -1 : 1;  //decided by the prefixes: most comparisons end here
+    }
+    if((ka & 0xff) == 0) {
+      return 0;  //both strings ended inside their equal prefixes
+    }
+    return strcmp(a->value + KEY_BYTES, b->value + KEY_BYTES);
+}
+
+/*
+  Merge two sorted, NULL-terminated lists of elements into one, taking
+  from a on ties. Each element's key is worked out once per merge, when
+  it reaches the front of its list.
+*/
+static list_ele_t *ele_merge(list_ele_t *a, list_ele_t *b)
+{
+    list_ele_t *head = NULL;
+    list_ele_t **link = &head;  //where the next element taken goes
+    unsigned long long ka = ele_key(a->value);
+    unsigned long long kb = ele_key(b->value);
+
+    for(;;) {
+      if(ele_cmp(a, ka, b, kb) <= 0) {
+        *link = a;
+        link = &a->next;
+        a = a->next;
+        if(a == NULL) {
+          *link = b;  //a is used up: the rest of b follows
+          break;
+        }
+        ka = ele_key(a->value);
+      } else {
+        *link = b;
+        link = &b->next;
+        b = b->next;
+        if(b == NULL) {
+          *link = a;
+          break;
+        }
+        kb = ele_key(b->value);
+      }
+    }
+    return head;
+}
+
+/*
+  Sort a NULL-terminated list of elements, bottom up: pending[k] holds a
+  sorted run of 2^k elements, and each element taken off the list
+  carries up through the runs like a bit being added to a binary counter
+*/
+static list_ele_t *ele_sort(list_ele_t *list)
+{
+    list_ele_t *pending[SORT_LEVELS] = { NULL };
+
+    while(list != NULL) {
+      list_ele_t *run = list;
+      list = list->next;
+      run->next = NULL;
+
+      int k;
+      for(k = 0; pending[k] != NULL; k++) {
+        run = ele_merge(pending[k], run);  //pending[k] came first, so it goes first on ties
+        pending[k] = NULL;
+      }
+      pending[k] = run;
+    }
+
+    list_ele_t *sorted = NULL;
+    for(int k = 0; k < SORT_LEVELS; k++) {
+      if(pending[k] != NULL) {
+        sorted = (sorted == NULL) ? pending[k] : ele_merge(pending[k], sorted);
+      }
+    }
+    return sorted;
+}
+
+/*
+  Sort elements of queue in ascending order
+  No effect if q is NULL or empty
+ */
+void q_sort(queue_t *q)
+{
+    if(q == NULL || q->size <= 1) {
+      return;
+    }
+
+    if(q->backend == Q_LIST) {
+      q->head = ele_sort(q->head);
+
+      list_ele_t *curr = q->head;  //find the new tail
+      while(curr->next != NULL) {
+        curr = curr->next;
+      }
+      q->tail = curr;
+      return;
+    }
+
+    /* Chunked: thread the elements on next, which a chunked queue
+       doesn't use, sort that list, and put them back in the same slots */
+    list_ele_t *list = NULL;
+    list_ele_t **link = &list;
+    for(struct q_chunk *c = q->first; c != NULL; c = c->next) {
+      int end = (c == q->last) ? q->last_pos : Q_CHUNK;
+      for(int i = (c == q->first) ? q->first_pos : 0; i < end; i++) {
+        *link = c->ele[i];
+        link = &c->ele[i]->next;
+      }
+    }
+    *link = NULL;
+
+    list = ele_sort(list);
+
+    q->reversed = false;  //the slots are refilled head first from the physical front
+    for(struct q_chunk *c = q->first; c != NULL; c = c->next) {
+      int end = (c == q->last) ? q->last_pos : Q_CHUNK;
+      for(int i = (c == q->first) ? q->first_pos : 0; i < end; i++) {
+        c->ele[i] = list;
+        list = list->next;
+      }
+    }
+}
+
+/*
+  Move all elements of other to the tail of q, leaving other empty.
+  Return true if successful.
+  Return false if either is NULL, they are the same queue, or could not
+  allocate space.
+ */
+bool q_concat(queue_t *q, queue_t *other)
+{
+    if(q == NULL || other == NULL || q == other) {
+      return false;
+    }
+
+    if(other->size == 0) {
+      return true;  //nothing to move, and no elements in other's slabs that anyone needs
+    }
+
+    if(q->backend == Q_LIST && other->backend == Q_LIST) {
+      if(q->size == 0) {
+        q->head = other->head;
+      } else {
+        q->tail->next = other->head;  //splice other's list after q's tail
+      }
+      q->tail = other->tail;
+      q->size += other->size;
+    } else {
+      struct q_chunk *pool = NULL;  //every chunk q could need, so no push below can fail
+      if(q->backend == Q_CHUNKED) {
+        for(int n = other->size / Q_CHUNK + 1; n > 0; n--) {
+          struct q_chunk *c = malloc(sizeof(struct q_chunk));
+          if(c == NULL) {
+            while(pool != NULL) {
+              c = pool;
+              pool = pool->next;
+              free(c);
+            }
+            return false;
+          }
+          c->next = pool;
+          pool = c;
+        }
+      }
+
+      while(other->size > 0) {
+        if(q->spare == NULL && pool != NULL) { //chunk_push takes the spare when it needs a chunk
+          q->spare = pool;
+          pool = pool->next;
+        }
+        ele_push_tail(q, ele_pop_head(other));
+      }
+
+      while(pool != NULL) {
+        struct q_chunk *c = pool;
+        pool = pool->next;
+        free(c);
+      }
+    }
+
+    /* The moved elements live in other's slabs: q takes those over too */
+    if(other->slabs != NULL) {
+      if(q->slabs == NULL) {
+        q->slabs = other->slabs;
+        q->oldest_slab = other->oldest_slab;
+      } else {
+        other->oldest_slab->next = q->slabs->next;  //behind q's newest slab, which q keeps carving from
+        if(q->slabs->next == NULL) {
+          q->oldest_slab = other->oldest_slab;
+        }
+        q->slabs->next = other->slabs;
+      }
+    }
+
+    if(other->large != NULL) { //and its large elements' blocks, ahead of q's
+      other->large_last->next = q->large;
+      if(q->large != NULL) {
+        q->large->prev = other->large_last;
+      } else {
+        q->large_last = other->large_last;
+      }
+      q->large = other->large;
+    }
+
+    for(int k = 0; k < Q_CLASSES; k++) {
+      if(q->free_ele[k] == NULL) {
+        q->free_ele[k] = other->free_ele[k];
+      }  //otherwise other's free elements just sit in their slab until q_free
+      other->free_ele[k] = NULL;
+    }
+    if(q->adopted == NULL) { //join the rings of adopted elements
+      q->adopted = other->adopted;
+    } else if(other->adopted != NULL) {
+      list_ele_t *q_last = ADOPTED(q->adopted)->prev;
+      list_ele_t *other_last = ADOPTED(other->adopted)->prev;
+      ADOPTED(q_last)->next = other->adopted;
+      ADOPTED(other->adopted)->prev = q_last;
+      ADOPTED(other_last)->next = q->adopted;
+      ADOPTED(q->adopted)->prev = other_last;
+    }
+
+    other->head = NULL;  //other is empty, and owns no element storage
+    other->tail = NULL;
+    other->size = 0;
+    other->slabs = NULL;
+    other->oldest_slab = NULL;
+    other->large = NULL;
+    other->large_last = NULL;
+    other->adopted = NULL;
+    return true;
+}
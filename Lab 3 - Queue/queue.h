@@ -7,21 +7,63 @@
  * This program implements a queue supporting both FIFO and LIFO
  * operations.
  *
- * It uses a singly-linked list to represent the set of queue elements
+ * It uses a singly-linked list to represent the set of queue elements,
+ * or optionally a deque of fixed-size chunks of element pointers
  */
 
 #include <stdbool.h>
 
 /************** Data structure declarations ****************/
 
-/* Linked list element (You shouldn't need to change this) */
+/*
+  Strings shorter than this fit in every element's own storage, so
+  elements holding them are all the same size
+*/
+#define Q_INLINE 16
+
+/* Linked list element */
 typedef struct ELE {
     /* Pointer to array holding string.
-       This array needs to be explicitly allocated and freed */
+       This points at data below: the element and its string are one
+       allocation, freed together. An adopted string (see
+       q_insert_tail_adopt) is the one exception: it is its own block */
     char *value;
     struct ELE *next;
+    char data[];  /* the string, max(strlen + 1, Q_INLINE) bytes */
 } list_ele_t;
 
+/*
+  Elements sizes are powers of two from the smallest element up, one
+  size class each; class Q_CLASSES - 1 is the largest (64 KiB). Bigger
+  elements are allocated one at a time, at their exact size
+*/
+#define Q_CLASSES 12
+
+/* A block of memory elements are carved from (see queue.c) */
+struct q_slab;
+
+/* The block of an element too big for any size class */
+struct q_large;
+
+/* Elements per chunk of a chunked queue */
+#define Q_CHUNK 62
+
+/*
+  A chunk of a chunked queue: part of a doubly-linked deque of chunks,
+  each holding up to Q_CHUNK element pointers in order
+*/
+struct q_chunk {
+    struct q_chunk *prev;
+    struct q_chunk *next;
+    list_ele_t *ele[Q_CHUNK];
+};
+
+/* How a queue keeps its elements in order */
+typedef enum {
+    Q_LIST,     /* a singly-linked list through the elements (the default) */
+    Q_CHUNKED   /* a deque of chunks; head and tail are unused */
+} q_backend_t;
+
 /* Queue structure */
 typedef struct {
     list_ele_t *head;  /* Linked list of elements */
@@ -31,6 +73,22 @@ typedef struct {
     */
     list_ele_t *tail; /*tail of the linked list */
     int size; /*current size of linked list */
+    struct q_slab *slabs;  /* memory of all the elements, newest slab first */
+    struct q_slab *oldest_slab;  /* the last slab on slabs, so q_concat can splice */
+    struct q_large *large;  /* blocks of elements too big for the slabs */
+    struct q_large *large_last;  /* the last block on large, for the same reason */
+    list_ele_t *free_ele[Q_CLASSES];  /* removed elements to reuse, by size class */
+    q_backend_t backend;
+    /* Q_CHUNKED: the elements are first->ele[first_pos] through
+       last->ele[last_pos - 1], in order, or reversed if reversed is set */
+    struct q_chunk *first;
+    struct q_chunk *last;
+    int first_pos;
+    int last_pos;
+    bool reversed;
+    struct q_chunk *spare;  /* an emptied chunk kept for reuse, or NULL */
+    list_ele_t *adopted;  /* ring of the elements holding an adopted string, whose
+                             strings q_free must free (see queue.c), or NULL */
 } queue_t;
 
 /************** Operations on queue ************************/
@@ -41,9 +99,20 @@ typedef struct {
 */
 queue_t *q_new();
 
+/*
+  Create empty queue that keeps its elements with the given backend.
+  Return NULL if could not allocate space.
+  All the operations below work on either kind. A chunked queue does
+  O(1) work per insert and remove like a list, but reverses in O(1) and
+  walks its elements through arrays instead of chasing a pointer each.
+*/
+queue_t *q_new_backend(q_backend_t backend);
+
 /*
   Free ALL storage used by queue.
   No effect if q is NULL
+  Elements live in slabs owned by the queue, so this frees each slab,
+  not each element (only adopted strings are freed one by one).
 */
 void q_free(queue_t *q);
 
@@ -75,6 +144,43 @@ bool q_insert_tail(queue_t *q, char *s);
 */
 bool q_remove_head(queue_t *q, char *sp, size_t bufsize);
 
+/*
+  Attempt to insert element at head (or tail) of queue without copying
+  the string.
+  Return true if successful: q now owns s, which must have come from
+  malloc, and frees it when the element is removed.
+  Return false if q or s is NULL or could not allocate space, and s is
+  still the caller's.
+ */
+bool q_insert_head_adopt(queue_t *q, char *s);
+bool q_insert_tail_adopt(queue_t *q, char *s);
+
+/*
+  Attempt to remove element from head of queue and hand its string to the
+  caller, who must free it.
+  Return the string, or NULL if q is NULL or empty, or could not allocate
+  space (the queue is then unchanged).
+  An adopted string is handed back as it is; a string that was copied in
+  is copied out once, into a block of its own.
+*/
+char *q_remove_head_take(queue_t *q);
+
+/*
+  Attempt to insert n elements at tail of queue, in order: sv[0] ends up
+  nearest the head. Each string is copied, as by q_insert_tail.
+  Return the number inserted: n, or fewer if could not allocate space
+  (those inserted stay inserted).
+ */
+int q_insert_tail_n(queue_t *q, char **sv, int n);
+
+/*
+  Attempt to remove up to n elements from head of queue.
+  Return the number removed: n, or fewer if the queue ran out, 0 if q is NULL.
+  If sp is non-NULL, the i'th string removed is copied to sp + i * bufsize,
+  as q_remove_head would copy it, so sp must have room for n * bufsize bytes.
+*/
+int q_remove_head_n(queue_t *q, char *sp, size_t bufsize, int n);
+
 /*
   Return number of elements in queue.
   Return 0 if q is NULL or empty
@@ -89,3 +195,25 @@ int q_size(queue_t *q);
   It should rearrange the existing ones.
  */
 void q_reverse(queue_t *q);
+
+/*
+  Sort elements of queue in ascending order, as strcmp orders their
+  strings; elements with equal strings keep their order.
+  No effect if q is NULL or empty
+  Like q_reverse, this relinks the existing elements and does not
+  allocate or free any.
+ */
+void q_sort(queue_t *q);
+
+/*
+  Move all elements of other to the tail of q, in order, leaving other
+  empty (it must still be freed with q_free).
+  Return true if successful.
+  Return false if either is NULL, they are the same queue, or could not
+  allocate space; both queues are then unchanged.
+  Between two list queues this takes constant time: the elements, their
+  slabs and their large blocks are all spliced, not walked. Only a
+  chunked queue is linear, as its element pointers have to be moved one
+  by one, though the elements themselves are not.
+ */
+bool q_concat(queue_t *q, queue_t *other);
@@ -0,0 +1,9 @@
+# Test performance of insert_tail, reverse and free at 16x scale
+option fail 0
+option malloc 0
+new
+ih dolphin 16000000
+it gerbil 16000
+reverse
+it jaguar 16000
+free
@@ -0,0 +1,9 @@
+# Test performance of insert_tail, reverse and free at 4x scale
+option fail 0
+option malloc 0
+new
+ih dolphin 4000000
+it gerbil 4000
+reverse
+it jaguar 4000
+free
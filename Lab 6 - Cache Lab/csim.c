@@ -1,334 +1,2900 @@
-/*
- * csim.c - A cache simulator that can replay traces from Valgrind
- *     and output statistics such as number of hits, misses, and
- *     evictions.  The replacement policy is LRU.
- *
- * Implementation and assumptions:
- *
- *  1. Each load/store can cause at most one cache miss. (I examined the trace,
- *  the largest request I saw was for 8 bytes).
- *
- *  2. Instruction loads (I) are ignored, since we are interested in evaluating
- *  data cache performance.
- *
- *  3. data modify (M) is treated as a load followed by a store to the same
- *  address. Hence, an M operation can result in two cache hits, or a miss and a
- *  hit plus an possible eviction.
- *
- * The function printSummary() is given to print output.
- * Please use this function to print the number of hits, misses and evictions.
- * IMPORTANT: This is crucial for the driver to evaluate your work.
- *
- */
-
-#include <getopt.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <stdio.h>
-#include <assert.h>
-#include <math.h>
-#include <limits.h>
-#include <string.h>
-#include <errno.h>
-
-//#define DEBUG_ON
-#define ADDRESS_LENGTH 64
-
-/* Type: Memory address */
-typedef unsigned long long int mem_addr_t;
-
-/*
- * Data structures to represent the cache we are simulating
- *
- *
- *
- * E.g., Types: cache, cache line, cache set
- * (you can use a counter to implement LRU replacement policy)
- */
-
-typedef struct line {  //struct for a line in the cache
-  mem_addr_t tag;
-  int lru_count;
-  int valid;
-} cache_line_t;
-
-typedef cache_line_t *cache_set_t;  //lines make up a set
-typedef cache_set_t *cache_t;   //sets make up cache
-
-cache_t cache; //the cache
-
-/* Globals set by command line args */
-int verbosity = 0; /* print trace if set */
-int s = 0; /* set index bits */
-int b = 0; /* block offset bits */
-int E = 0; /* associativity */
-char* trace_file = NULL;
-
-/* Derived from command line args */
-int S; /* number of sets */
-int B; /* block size (bytes) */
-
-/* Counters used to record cache statistics */
-int miss_count = 0;
-int hit_count = 0;
-int eviction_count = 0;
-
-/*
- * initCache - Allocate memory (with malloc) for cache data structures (i.e., for each of the sets and lines per set),
- * writing 0's for valid and tag and LRU
- *
- *
- *
- */
-void initCache()
-{
-  cache = malloc(S * sizeof(cache_set_t)); //allocate space for S(# of sets) * size of a set
-
-  for(int i = 0; i < S; i++) { //loop through each set
-    cache[i] = malloc(E * sizeof(cache_line_t)); //allocate space for E(# of lines per set) * size of a line
-
-    for(int j = 0; j < E; j++) { //loop through each line
-      cache[i][j].valid = 0;
-      cache[i][j].tag = 0;
-      cache[i][j].lru_count = 0;
-    }
-  }
-}
-
-
-/*
- * freeCache - free allocated memory
- *
- * This function deallocates (with free) the cache data structures of each
- * set and line.
- *
- * 
- */
-void freeCache()
-{
-  for(int i = 0; i < S; i ++) {  //free each set
-    free(cache[i]);
-  }
-
-  free(cache); //free cache
-}
-
-
-/*
- * accessData - Access data at memory address addr
- *   If it is already in cache, increase hit_count
- *   If it is not in cache, bring it in cache, increase miss count.
- *   Also increase eviction_count if a line is evicted.
- *
- * 
- */
-void accessData(mem_addr_t addr)
-{
-  mem_addr_t tag = addr >> (b + s);          //set tag amd set addresses based on b, s, and S
-  mem_addr_t set = (addr >> b) & (S - 1);
-
-  int hit = 0; //if an address was a hit(1) or miss(0)
-
-  int MRU, LRU = cache[(int) set][0].lru_count;   //set most recently used and least recently used equal to first entry in the set's lru_count
-
-  for(int i = 0; i < E; i++) { //loop through lines in the set
-    if(MRU < cache[(int) set][i].lru_count){      //finds the most recently used line in the set
-      MRU = cache[(int) set][i].lru_count;
-    }
-    if(LRU > cache[(int) set][i].lru_count) { //finds the least recently used line in the set
-      LRU = cache[(int) set][i].lru_count;
-    }
-  }
-
-  for(int i = 0; i < E; i++) { //loop through lines in the set
-    if(cache[(int) set][i].tag == tag && cache[(int) set][i].valid){  //if the line's tag matches and the line is valid
-      hit_count++; //update hit count
-      hit = 1; //signifies a hit
-      cache[(int) set][i].lru_count = MRU + 1;//set the line's lru_count to the most recently used + 1
-      MRU++;
-      LRU++;
-      for(int j = 0; j < E; j++) { //loop through lines in the set again
-        if(LRU > cache[(int) set][j].lru_count){ //finds the new least recently used
-          LRU = cache[(int) set][j].lru_count;
-        }
-      }
-    }
-  }
-
-  if(hit == 0) { //if there was a miss
-    miss_count++; //update miss count
-
-    int check = 0;
-    for(int i = 0; i < E; i++) { //loop through lines in the set
-      if(cache[(int) set][i].valid == 0 && check == 0){ //if the line is not valid
-        cache[(int) set][i].tag = tag;
-        cache[(int) set][i].lru_count = MRU + 1;   //set the tag, lru_count, and valid
-        cache[(int) set][i].valid = '1';
-        MRU++;
-        LRU++;
-        hit = 1;
-        check = 1;
-        for(int j = 0; j < E; j++) { //loop through lines in the set again
-          if(LRU > cache[(int) set][j].lru_count){ //finds the new least recently used
-            LRU = cache[(int) set][j].lru_count;
-          }
-        }
-      }
-    }
-
-    check = 0;
-    if(hit == 0){ //if there was a miss and there was no room for the address to be inserted in the cache
-      for(int i = 0; i < E; i++) { //loop through lines in the set
-        if(cache[(int) set][i].lru_count == LRU && check == 0){ //find the least recently used and insert the new address (eviction)
-          cache[(int) set][i].tag = tag;
-          cache[(int) set][i].lru_count = MRU + 1;
-          MRU++;
-          LRU++;
-          eviction_count++; //update eviction count
-          hit = 1;
-          check = 1;
-        }
-      }
-    }
-  }
-}
-
-
-/*
- * replayTrace - replays the given trace file against the cache
- *
- * This function:
- * - opens file trace_fn for reading (using fopen)
- * - reads lines (e.g., using fgets) from the file handle (may name `trace_fp` variable)
- * - skips lines not starting with ` S`, ` L` or ` M`
- * - parses the memory address (unsigned long, in hex) and len (unsigned int, in decimal)
- *   from each input line
- * - calls `access_data(address)` for each access to a cache line
- *
- * 
- *
- */
-void replayTrace(char* trace_fn)
-{
-    FILE *trace_fp; //file handle
-    char str[2000]; //where the string read from fgets is stored
-    mem_addr_t memoryAddress;
-    unsigned int len ;
-
-    trace_fp = fopen(trace_fn, "r"); //open the file
-    if(trace_fp == NULL) {
-      printf("%s\n", "Error opening file"); //check if file is valid
-    }
-
-    while(fgets(str, 2000, trace_fp) != NULL) {
-      if(str[1] == 'S' || str[1] == 'L' || str[1] == 'M') { //only care about lines starting with 'S', 'L', or 'M'
-
-        sscanf(str+3, "%llx,%u", &memoryAddress, &len); //parses current string into memory address and len
-
-        accessData(memoryAddress);
-
-        if(str[1] == 'M') {  //the data modify operation is treated as a load followed by a store to the same address
-          accessData(memoryAddress);
-        }
-      }
-    }
-
-    fclose(trace_fp); //close the file
-}
-
-/*
- * printUsage - Print usage info
- */
-void printUsage(char* argv[])
-{
-    printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file>\n", argv[0]);
-    printf("Options:\n");
-    printf("  -h         Print this help message.\n");
-    printf("  -v         Optional verbose flag.\n");
-    printf("  -s <num>   Number of set index bits.\n");
-    printf("  -E <num>   Number of lines per set.\n");
-    printf("  -b <num>   Number of block offset bits.\n");
-    printf("  -t <file>  Trace file.\n");
-    printf("\nExamples:\n");
-    printf("  linux>  %s -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv[0]);
-    printf("  linux>  %s -v -s 8 -E 2 -b 4 -t traces/yi.trace\n", argv[0]);
-    exit(0);
-}
-
-/*
- *
- * !! DO NOT MODIFY !!
- *
- * printSummary - Summarize the cache simulation statistics. Student cache simulators
- *                must call this function in order to be properly autograded.
- */
-void printSummary(int hits, int misses, int evictions)
-{
-    printf("hits:%d misses:%d evictions:%d\n", hits, misses, evictions);
-    FILE* output_fp = fopen(".csim_results", "w");
-    assert(output_fp);
-    fprintf(output_fp, "%d %d %d\n", hits, misses, evictions);
-    fclose(output_fp);
-}
-
-/*
- * main - Main routine
- */
-int main(int argc, char* argv[])
-{
-    char c;
-
-    while( (c=getopt(argc,argv,"s:E:b:t:vh")) != -1){
-        switch(c){
-        case 's':
-            s = atoi(optarg);
-            break;
-        case 'E':
-            E = atoi(optarg);
-            break;
-        case 'b':
-            b = atoi(optarg);
-            break;
-        case 't':
-            trace_file = optarg;
-            break;
-        case 'v':
-            verbosity = 1;
-            break;
-        case 'h':
-            printUsage(argv);
-            exit(0);
-        default:
-            printUsage(argv);
-            exit(1);
-        }
-    }
-
-    /* Make sure that all required command line args were specified */
-    if (s == 0 || E == 0 || b == 0 || trace_file == NULL) {
-        printf("%s: Missing required command line argument\n", argv[0]);
-        printUsage(argv);
-        exit(1);
-    }
-
-    /* Compute S, E and B from command line args */
-    S = (unsigned int) pow(2, s);
-    B = (unsigned int) pow(2, b);
-
-    /* Initialize cache */
-    initCache();
-
-#ifdef DEBUG_ON
-    printf("DEBUG: S:%u E:%u B:%u trace:%s\n", S, E, B, trace_file);
-#endif
-
-    replayTrace(trace_file);
-
-    /* Free allocated memory */
-    freeCache();
-
-    /* Output the hit and miss statistics for the autograder */
-    printSummary(hit_count, miss_count, eviction_count);
-
-    return 0;
-}
+/*
+ * csim.c - A cache simulator that can replay traces from Valgrind
+ *     and output statistics such as number of hits, misses, and
+ *     evictions.  The replacement policy is LRU, unless another is
+ *     chosen with -r.
+ *
+ * Implementation and assumptions:
+ *
+ *  1. Each load/store can cause at most one cache miss. (I examined the trace,
+ *  the largest request I saw was for 8 bytes). With `-l` the size is honored
+ *  instead, and an access that crosses block boundaries touches every block it
+ *  covers, in address order.
+ *
+ *  2. Instruction loads (I) are ignored, since we are interested in evaluating
+ *  data cache performance.
+ *
+ *  3. data modify (M) is treated as a load followed by a store to the same
+ *  address. Hence, an M operation can result in two cache hits, or a miss and a
+ *  hit plus an possible eviction. (With `-l`, the loads of every block it
+ *  covers come before the stores.)
+ *
+ *  4. LRU order is kept as a doubly linked recency list through the lines of
+ *  each set, so a hit and picking the victim on a miss are O(1). For highly
+ *  associative caches the line holding a tag is found through a hash table
+ *  instead of a scan of the set, so the cost of an access does not grow with E.
+ *  E is at most 65535.
+ *
+ *  5. Smaller sets are scanned with a SIMD tag compare (AVX-512, AVX2 or NEON,
+ *  whichever the host has, checked at startup) or a scalar loop otherwise.
+ *
+ *  6. Traces are parsed in place from a mapping of the file (or a large stream
+ *  buffer), and may be compressed with gzip or zstd. `-c` converts a trace to a
+ *  compact, seekable binary format, which is detected automatically.
+ *
+ *  7. `-x` simulates a whole list or grid of geometries in one pass over the
+ *  trace, spread over worker threads.
+ *
+ *  8. `-p` splits the sets of one cache over worker threads fed by a trace
+ *  decoding thread, with the same results as a sequential run.
+ *
+ *  9. `-m` finds the LRU results of every associativity for one s and b in a
+ *  single pass, from the stack distance of each access.
+ *
+ *  10. `-L` adds lower levels under the cache, which becomes the L1 of a
+ *  hierarchy. `-i`, `-w` and `-a` choose inclusion, write-back or
+ *  write-through, and write-allocate or not; write-back caches keep dirty
+ *  lines and count their evictions, and the traffic to memory is counted too.
+ *  Sweeps and stack distance mode always model a single write-allocate cache.
+ *
+ *  11. `-r` replaces LRU with tree-PLRU, FIFO, random, SRRIP, BRRIP or
+ *  Belady's optimal policy. Belady needs the future, so that mode reads the
+ *  whole trace first and indexes when each access's block is next used.
+ *
+ * The function printSummary() is given to print output.
+ * Please use this function to print the number of hits, misses and evictions.
+ * IMPORTANT: This is crucial for the driver to evaluate your work.
+ *
+ */
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+//#define DEBUG_ON
+#define ADDRESS_LENGTH 64
+
+/* Type: Memory address */
+typedef unsigned long long int mem_addr_t;
+
+/*
+ * Data structures to represent the cache we are simulating
+ *
+ * The cache is one allocation laid out as a structure of arrays. The tags of a
+ * set are contiguous, and each set's run of tags is padded to a power of two
+ * (or a multiple of 8) entries so a set never straddles more host cache lines
+ * than it must. Valid bits are packed into one bitmask per set.
+ *
+ * LRU order is a doubly linked recency list through the lines of each set,
+ * most recently used first, linked by 16-bit line index, which limits E to
+ * MAX_E. Other replacement policies (see policy_t) keep their own per-set or
+ * per-line state, allocated only for the policy in use.
+ */
+
+#define MAX_E 65535
+#define NO_LINE 0xFFFF   //end of a recency list
+
+/*
+ * An open addressing hash table (linear probing) keyed by block number
+ * (addr >> b), which names both the set and the tag. The cache uses it to find
+ * the line holding a block; stack distance mode to find a block's last access.
+ */
+typedef struct lookup {
+  struct slot {
+    mem_addr_t key;    //block number + 1, or 0 if the slot is empty
+    int value;
+  } *slots;            //the table, or NULL if there is none
+  mem_addr_t mask;     //number of slots - 1
+} lookup_t;
+
+typedef struct cache {
+  /* Geometry */
+  int s;               //set index bits
+  int b;               //block offset bits
+  int E;               //lines per set
+  int S;               //number of sets
+  int stride;          //tag slots per set, E rounded up
+  int valid_words;     //64-bit valid words per set
+
+  /*
+   * A cache may be one shard of a bigger one: it then holds only the sets
+   * whose low shard_bits index bits equal its shard number, set i at row
+   * i >> shard_bits. The arrays below have one entry (or run) per row.
+   */
+  int shard_bits;
+  int rows;
+
+  mem_addr_t *tags;    //rows * stride tags, those of row i from i * stride
+  uint64_t *valid;     //rows * valid_words valid bitmasks
+  uint64_t *dirty;     //rows * valid_words dirty bitmasks, for write-back caches
+  uint16_t *prev;      //rows * E: next more recently used line in the set
+  uint16_t *next;      //rows * E: next less recently used line in the set
+  uint16_t *mru;       //rows: head of each recency list
+  uint16_t *lru;       //rows: tail of each recency list, the next victim
+
+  const struct policy *policy; //replacement policy
+  uint64_t *plru;      //rows * valid_words: tree-PLRU bits, node n (1 .. E-1) at bit n
+  uint8_t *rrpv;       //rows * E: re-reference prediction values, for SRRIP and BRRIP
+  uint64_t *draws;     //rows: random numbers drawn by each set, for random and BRRIP
+  uint32_t *next_use;  //rows * E: when each line's block is next accessed, for Belady
+  uint32_t upcoming;   //Belady: when the block being accessed is next accessed
+
+  lookup_t lookup;     //tag lookup, for caches with more than lookup_min_e lines per set
+
+  void *memory;        //the one allocation everything above lives in
+
+  /* Counters used to record cache statistics */
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+  unsigned long dirty_evictions;
+} cache_t;
+
+/*
+ * A replacement policy, as the hooks accessData calls. Free lines are always
+ * filled first, lowest first, so victim is only asked about full sets.
+ */
+typedef struct policy {
+  const char *name;
+  void (*hit)(cache_t *cache, mem_addr_t row, int i);                    //line i was accessed
+  void (*fill)(cache_t *cache, mem_addr_t row, int i, mem_addr_t block); //line i was given block
+  int (*victim)(cache_t *cache, mem_addr_t row, mem_addr_t block);       //line to evict for block
+  void (*remove)(cache_t *cache, mem_addr_t row, int i);                 //line i was invalidated
+  int flags;           //POLICY_* state it needs, and limits
+} policy_t;
+
+#define POLICY_TREE 1      //tree bits
+#define POLICY_RRPV 2      //re-reference prediction values
+#define POLICY_DRAWS 4     //random number state
+#define POLICY_NEXT_USE 8  //next use times
+#define POLICY_POW2 16     //E must be a power of two
+#define POLICY_OFFLINE 32  //needs the next use time of each access
+
+/*
+ * A hierarchy is the cache (L1) over up to MAX_LEVELS - 1 lower levels, all
+ * with the same block size. Memory traffic is counted in blocks.
+ */
+#define MAX_LEVELS 4
+
+typedef struct hierarchy {
+  int levels;
+  cache_t level[MAX_LEVELS];
+  unsigned long mem_reads;  //blocks fetched from memory
+  unsigned long mem_writes; //blocks written to memory, including each write-through store
+} hierarchy_t;
+
+typedef enum { INCLUSION_NINE, INCLUSION_INCLUSIVE, INCLUSION_EXCLUSIVE } inclusion_t;
+
+hierarchy_t hierarchy; //the cache, plus any lower levels
+
+/*
+ * Tag match kernel: returns a bitmask with bit i set if tags[i] == tag, for
+ * n <= 64. Chosen by selectKernels() for the host CPU.
+ */
+typedef uint64_t (*match_fn_t)(const mem_addr_t *tags, int n, mem_addr_t tag);
+
+static uint64_t matchTagsScalar(const mem_addr_t *tags, int n, mem_addr_t tag);
+match_fn_t matchTags = matchTagsScalar;
+
+/* Largest E for which sets are scanned rather than looked up in a hash table;
+   a vector kernel can afford to scan bigger sets */
+int lookup_min_e = 8;
+
+/* Globals set by command line args */
+int verbosity = 0; /* print trace if set */
+int s = 0; /* set index bits */
+int b = 0; /* block offset bits */
+int E = 0; /* associativity */
+char* trace_file = NULL;
+char* convert_file = NULL; /* write the trace here in binary format instead of simulating */
+size_t skip_records = 0; /* records at the start of the trace to skip */
+
+/* Derived from command line args */
+int S; /* number of sets */
+int B; /* block size (bytes) */
+char* sweep_spec = NULL; /* geometries to simulate at once instead of -s, -E and -b */
+int jobs = 0; /* worker threads for a sweep or sharded replay; 0 means one per CPU */
+int shard_mode = 0; /* split the sets of the cache over jobs worker threads */
+int stack_mode = 0; /* print the miss ratio curve for all E instead of simulating one cache */
+int honor_len = 0; /* an access touches every block its size covers, not just the first */
+int levels = 1; /* caches in the hierarchy, the first given by -s and -E */
+int level_s[MAX_LEVELS]; /* set index bits of each level below the first */
+int level_E[MAX_LEVELS]; /* associativity of each level below the first */
+int hierarchy_mode = 0; /* simulate lower levels or write policies, not just one cache */
+int write_back = 1; /* write-back rather than write-through */
+int write_allocate = 1; /* a store that misses brings the block in */
+inclusion_t inclusion = INCLUSION_NINE; /* how lower levels relate to the ones above */
+int replacement = 0; /* index of the replacement policy in policies, LRU by default */
+
+/*
+ * carve - Return the next n bytes of an allocation at *p, aligned to 64 bytes
+ */
+static void *carve(char **p, size_t n)
+{
+  void *start = *p;
+  *p += (n + 63) & ~(size_t) 63;
+  return start;
+}
+
+/*
+ * initCache - Allocate memory (with malloc) for the cache data structures of
+ * the given geometry in a single block, writing 0's for valid and tag and
+ * emptying each set's recency list. Also allocates the tag lookup table if E
+ * is large enough to need it, and whatever state the replacement policy
+ * keeps. With shard_bits > 0 the cache is one shard, holding 1 in
+ * 2^shard_bits of the sets. Returns 0, or -1 if memory ran out.
+ */
+int initCache(cache_t *cache, int s, int E, int b, int shard_bits, const policy_t *policy)
+{
+  size_t S = (size_t) 1 << (s - shard_bits); //sets actually held
+  int stride = E;
+
+  if(E > 8) {   //round E up so sets start on the same host cache line offsets
+    stride = (E + 7) & ~7;
+  } else {
+    for(stride = 1; stride < E; stride <<= 1);
+  }
+
+  cache->s = s;
+  cache->b = b;
+  cache->E = E;
+  cache->S = 1 << s;
+  cache->shard_bits = shard_bits;
+  cache->rows = (int) S;
+  cache->stride = stride;
+  cache->valid_words = (E + 63) / 64;
+  cache->policy = policy;
+
+  size_t lookup_slots = 0;
+  if(E > lookup_min_e) { //at least twice as many slots as lines keeps probe sequences short
+    for(lookup_slots = 1; lookup_slots < 2 * S * E; lookup_slots <<= 1);
+  }
+
+  size_t size = 64 + ((S * stride * sizeof(mem_addr_t) + 63) & ~(size_t) 63)   //64 spare bytes to align the start
+              + 2 * ((S * cache->valid_words * sizeof(uint64_t) + 63) & ~(size_t) 63)
+              + 2 * ((S * E * sizeof(uint16_t) + 63) & ~(size_t) 63)
+              + 2 * ((S * sizeof(uint16_t) + 63) & ~(size_t) 63)
+              + lookup_slots * sizeof(struct slot);
+  size_t plru_size = (policy->flags & POLICY_TREE) ? S * cache->valid_words * sizeof(uint64_t) : 0;
+  size_t rrpv_size = (policy->flags & POLICY_RRPV) ? S * E * sizeof(uint8_t) : 0;
+  size_t draws_size = (policy->flags & POLICY_DRAWS) ? S * sizeof(uint64_t) : 0;
+  size_t next_use_size = (policy->flags & POLICY_NEXT_USE) ? S * E * sizeof(uint32_t) : 0;
+  size += ((plru_size + 63) & ~(size_t) 63) + ((rrpv_size + 63) & ~(size_t) 63)
+        + ((draws_size + 63) & ~(size_t) 63) + ((next_use_size + 63) & ~(size_t) 63);
+
+  cache->memory = calloc(1, size);
+  if(cache->memory == NULL) {
+    return -1;
+  }
+
+  char *p = (char *) (((uintptr_t) cache->memory + 63) & ~(uintptr_t) 63);
+  cache->tags = carve(&p, S * stride * sizeof(mem_addr_t));
+  cache->valid = carve(&p, S * cache->valid_words * sizeof(uint64_t));
+  cache->dirty = carve(&p, S * cache->valid_words * sizeof(uint64_t));
+  cache->prev = carve(&p, S * E * sizeof(uint16_t));
+  cache->next = carve(&p, S * E * sizeof(uint16_t));
+  cache->mru = carve(&p, S * sizeof(uint16_t));
+  cache->lru = carve(&p, S * sizeof(uint16_t));
+  cache->lookup.slots = lookup_slots ? carve(&p, lookup_slots * sizeof(struct slot)) : NULL;
+  cache->lookup.mask = lookup_slots - 1;
+  cache->plru = plru_size ? carve(&p, plru_size) : NULL;
+  cache->rrpv = rrpv_size ? carve(&p, rrpv_size) : NULL;
+  cache->draws = draws_size ? carve(&p, draws_size) : NULL;
+  cache->next_use = next_use_size ? carve(&p, next_use_size) : NULL;
+
+  for(size_t i = 0; i < S; i++) { //every recency list starts empty
+    cache->mru[i] = NO_LINE;
+    cache->lru[i] = NO_LINE;
+  }
+
+  return 0;
+}
+
+
+/*
+ * freeCache - free allocated memory
+ *
+ * This function deallocates (with free) the cache data structures.
+ */
+void freeCache(cache_t *cache)
+{
+  free(cache->memory);
+}
+
+/*
+ * lookupSlot - Return the slot a block number hashes to
+ */
+static mem_addr_t lookupSlot(lookup_t *table, mem_addr_t block)
+{
+  return (block * 0x9E3779B97F4A7C15ULL) >> 20 & table->mask; //Fibonacci hashing; the middle bits mix best
+}
+
+/*
+ * lookupFind - Return the slot holding block, or NULL if it isn't there
+ */
+static struct slot *lookupFind(lookup_t *table, mem_addr_t block)
+{
+  struct slot *slots = table->slots;
+
+  for(mem_addr_t i = lookupSlot(table, block); slots[i].key != 0; i = (i + 1) & table->mask) {
+    if(slots[i].key == block + 1) {
+      return &slots[i];
+    }
+  }
+  return NULL;
+}
+
+/*
+ * lookupInsert - Add block, which must not be there already, with the given value
+ */
+static void lookupInsert(lookup_t *table, mem_addr_t block, int value)
+{
+  struct slot *slots = table->slots;
+  mem_addr_t i = lookupSlot(table, block);
+
+  while(slots[i].key != 0) {
+    i = (i + 1) & table->mask;
+  }
+  slots[i].key = block + 1;
+  slots[i].value = value;
+}
+
+/*
+ * lookupRemove - Remove block, shifting back any later entries of its probe
+ * sequence into the hole so that lookups never need tombstones
+ */
+static void lookupRemove(lookup_t *table, mem_addr_t block)
+{
+  struct slot *slots = table->slots;
+  mem_addr_t mask = table->mask;
+  mem_addr_t i = lookupSlot(table, block);
+
+  while(slots[i].key != block + 1) {
+    i = (i + 1) & mask;
+  }
+
+  for(mem_addr_t j = (i + 1) & mask; slots[j].key != 0; j = (j + 1) & mask) {
+    mem_addr_t home = lookupSlot(table, slots[j].key - 1);
+    if(((j - home) & mask) >= ((j - i) & mask)) { //entry j may move back into the hole at i
+      slots[i] = slots[j];
+      i = j;
+    }
+  }
+  slots[i].key = 0;
+}
+
+/*
+ * lookupGrow - Double the slots of a table that grows as needed (the first
+ * time, make 2^16 of them). Returns 0, or -1 if out of memory.
+ */
+static int lookupGrow(lookup_t *table)
+{
+  lookup_t old = *table;
+  mem_addr_t slots = old.slots ? 2 * (old.mask + 1) : 1 << 16;
+
+  table->slots = calloc(slots, sizeof(struct slot));
+  if(table->slots == NULL) {
+    *table = old;
+    return -1;
+  }
+  table->mask = slots - 1;
+
+  for(mem_addr_t i = 0; old.slots != NULL && i <= old.mask; i++) {
+    if(old.slots[i].key != 0) {
+      lookupInsert(table, old.slots[i].key - 1, old.slots[i].value);
+    }
+  }
+  free(old.slots);
+  return 0;
+}
+
+/*
+ * matchTagsScalar - Tag match kernel for any CPU
+ */
+static uint64_t matchTagsScalar(const mem_addr_t *tags, int n, mem_addr_t tag)
+{
+  uint64_t mask = 0;
+
+  for(int i = 0; i < n; i++) {
+    mask |= (uint64_t) (tags[i] == tag) << i;
+  }
+  return mask;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/*
+ * matchTagsAVX2 - Tag match kernel comparing four tags at a time
+ */
+__attribute__((target("avx2")))
+static uint64_t matchTagsAVX2(const mem_addr_t *tags, int n, mem_addr_t tag)
+{
+  __m256i key = _mm256_set1_epi64x((long long) tag);
+  uint64_t mask = 0;
+  int i = 0;
+
+  for(; i + 4 <= n; i += 4) {
+    __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *) (tags + i)), key);
+    mask |= (uint64_t) _mm256_movemask_pd(_mm256_castsi256_pd(eq)) << i;
+  }
+  for(; i < n; i++) { //sets of one or two lines
+    mask |= (uint64_t) (tags[i] == tag) << i;
+  }
+  return mask;
+}
+
+/*
+ * matchTagsAVX512 - Tag match kernel comparing eight tags at a time
+ */
+__attribute__((target("avx512f")))
+static uint64_t matchTagsAVX512(const mem_addr_t *tags, int n, mem_addr_t tag)
+{
+  __m512i key = _mm512_set1_epi64((long long) tag);
+  uint64_t mask = 0;
+  int i = 0;
+
+  for(; i + 8 <= n; i += 8) {
+    mask |= (uint64_t) _mm512_cmpeq_epi64_mask(_mm512_loadu_si512((const void *) (tags + i)), key) << i;
+  }
+  if(i < n) { //sets of fewer than eight lines: compare a masked vector
+    __mmask8 lanes = (__mmask8) ((1u << (n - i)) - 1);
+    mask |= (uint64_t) _mm512_mask_cmpeq_epi64_mask(lanes, _mm512_maskz_loadu_epi64(lanes, tags + i), key) << i;
+  }
+  return mask;
+}
+#endif
+
+#if defined(__aarch64__)
+/*
+ * matchTagsNEON - Tag match kernel comparing two tags at a time
+ */
+static uint64_t matchTagsNEON(const mem_addr_t *tags, int n, mem_addr_t tag)
+{
+  uint64x2_t key = vdupq_n_u64(tag);
+  uint64_t mask = 0;
+  int i = 0;
+
+  for(; i + 2 <= n; i += 2) {
+    uint64x2_t eq = vceqq_u64(vld1q_u64((const uint64_t *) (tags + i)), key);
+    mask |= ((vgetq_lane_u64(eq, 0) & 1) | (vgetq_lane_u64(eq, 1) & 2)) << i;
+  }
+  if(i < n) {
+    mask |= (uint64_t) (tags[i] == tag) << i;
+  }
+  return mask;
+}
+#endif
+
+/*
+ * selectKernels - Pick the fastest tag match kernel the CPU supports
+ */
+void selectKernels()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f")) {
+    matchTags = matchTagsAVX512;
+    lookup_min_e = 64;
+  } else if(__builtin_cpu_supports("avx2")) {
+    matchTags = matchTagsAVX2;
+    lookup_min_e = 64;
+  }
+#elif defined(__aarch64__)
+  matchTags = matchTagsNEON;  //NEON is always there on AArch64
+  lookup_min_e = 32;
+#endif
+}
+
+/*
+ * findLine - Return the line of the set at row holding tag, or -1 on a miss
+ */
+static inline int findLine(cache_t *cache, mem_addr_t row, mem_addr_t block, mem_addr_t tag)
+{
+  if(cache->lookup.slots != NULL) {
+    struct slot *slot = lookupFind(&cache->lookup, block);
+    return (slot != NULL) ? slot->value : -1;
+  }
+
+  //E <= lookup_min_e <= 64, so there is one valid word, and its bits past E are clear
+  uint64_t hits = matchTags(&cache->tags[row * cache->stride], cache->stride, tag) & cache->valid[row];
+
+  return (hits != 0) ? __builtin_ctzll(hits) : -1;
+}
+
+/*
+ * findFree - Return a line of the set at row that isn't valid, or -1 if the set is full
+ */
+static inline int findFree(cache_t *cache, mem_addr_t row)
+{
+  const uint64_t *valid = &cache->valid[row * cache->valid_words];
+
+  for(int w = 0; w < cache->valid_words; w++) {
+    uint64_t empty = ~valid[w];
+    if(w == cache->valid_words - 1 && cache->E % 64 != 0) { //ignore bits past the last line
+      empty &= ((uint64_t) 1 << (cache->E % 64)) - 1;
+    }
+    if(empty != 0) {
+      return w * 64 + __builtin_ctzll(empty);
+    }
+  }
+  return -1;
+}
+
+/*
+ * touchLine - Move a line to the front of its set's recency list, linking it
+ * in if it was just filled
+ */
+static void touchLine(cache_t *cache, mem_addr_t row, int i)
+{
+  uint16_t *prev = &cache->prev[row * cache->E];
+  uint16_t *next = &cache->next[row * cache->E];
+  uint16_t *mru = &cache->mru[row];
+
+  if(*mru == i) {
+    return;
+  }
+
+  if(prev[i] != NO_LINE) { //unlink the line from where it is now
+    next[prev[i]] = next[i];
+    if(next[i] != NO_LINE) {
+      prev[next[i]] = prev[i];
+    } else {
+      cache->lru[row] = prev[i];
+    }
+  }
+
+  prev[i] = NO_LINE; //and link it back in at the front
+  next[i] = *mru;
+  if(*mru != NO_LINE) {
+    prev[*mru] = i;
+  } else {
+    cache->lru[row] = i;
+  }
+  *mru = i;
+}
+
+
+/*
+ * unlinkLine - Take a line off its set's recency list
+ */
+static void unlinkLine(cache_t *cache, mem_addr_t row, int i)
+{
+  uint16_t *prev = &cache->prev[row * cache->E];
+  uint16_t *next = &cache->next[row * cache->E];
+
+  if(prev[i] != NO_LINE) {
+    next[prev[i]] = next[i];
+  } else {
+    cache->mru[row] = next[i];
+  }
+  if(next[i] != NO_LINE) {
+    prev[next[i]] = prev[i];
+  } else {
+    cache->lru[row] = prev[i];
+  }
+  prev[i] = next[i] = NO_LINE;
+}
+
+/*
+ * Replacement policies
+ *
+ * LRU evicts the tail of the recency list, and FIFO too, but only moves a line
+ * to the front when it is filled. Tree-PLRU keeps E - 1 bits per set in a
+ * binary tree over the lines, each pointing to the half to evict from next.
+ * SRRIP and BRRIP (Jaleel et al., 2010) predict each line's re-reference
+ * interval with two bits: lines are filled at 2 (BRRIP: at 3, or 2 one fill in
+ * 32), set to 0 on a hit, and a line at 3 is evicted, aging the whole set
+ * until there is one. Belady evicts the line whose block is used again
+ * furthest in the future.
+ *
+ * The random draws of a set depend only on its own accesses, so splitting the
+ * sets over shards (-p) doesn't change the results.
+ */
+
+#define RRPV_MAX 3
+#define NEVER UINT32_MAX //next use time of a block that isn't used again
+
+static void noHit(cache_t *cache, mem_addr_t row, int i)
+{
+  (void) cache;
+  (void) row;
+  (void) i;
+}
+
+static void noFill(cache_t *cache, mem_addr_t row, int i, mem_addr_t block)
+{
+  (void) cache;
+  (void) row;
+  (void) i;
+  (void) block;
+}
+
+static void lruFill(cache_t *cache, mem_addr_t row, int i, mem_addr_t block)
+{
+  (void) block;
+  touchLine(cache, row, i);
+}
+
+static int lruVictim(cache_t *cache, mem_addr_t row, mem_addr_t block)
+{
+  (void) block;
+  return cache->lru[row];
+}
+
+/*
+ * drawSet - The next random number of the set at row, for an access to block
+ */
+static uint64_t drawSet(cache_t *cache, mem_addr_t row, mem_addr_t block)
+{
+  uint64_t x = (block & (cache->S - 1)) * 0x9E3779B97F4A7C15ULL + ++cache->draws[row]; //splitmix64
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+static int randomVictim(cache_t *cache, mem_addr_t row, mem_addr_t block)
+{
+  return (int) (((drawSet(cache, row, block) >> 32) * (uint64_t) cache->E) >> 32);
+}
+
+static void plruHit(cache_t *cache, mem_addr_t row, int i)
+{
+  uint64_t *bits = &cache->plru[row * cache->valid_words];
+
+  for(unsigned node = (unsigned) i + cache->E; node > 1; node >>= 1) { //point each node above away from i
+    unsigned parent = node >> 1;
+    if(node & 1) {
+      bits[parent / 64] &= ~((uint64_t) 1 << (parent % 64));
+    } else {
+      bits[parent / 64] |= (uint64_t) 1 << (parent % 64);
+    }
+  }
+}
+
+static void plruFill(cache_t *cache, mem_addr_t row, int i, mem_addr_t block)
+{
+  (void) block;
+  plruHit(cache, row, i);
+}
+
+static int plruVictim(cache_t *cache, mem_addr_t row, mem_addr_t block)
+{
+  const uint64_t *bits = &cache->plru[row * cache->valid_words];
+  unsigned node = 1;
+
+  (void) block;
+  while(node < (unsigned) cache->E) {
+    node = 2 * node + ((bits[node / 64] >> (node % 64)) & 1);
+  }
+  return (int) (node - cache->E);
+}
+
+static void rripHit(cache_t *cache, mem_addr_t row, int i)
+{
+  cache->rrpv[row * cache->E + i] = 0;
+}
+
+static void srripFill(cache_t *cache, mem_addr_t row, int i, mem_addr_t block)
+{
+  (void) block;
+  cache->rrpv[row * cache->E + i] = RRPV_MAX - 1;
+}
+
+static void brripFill(cache_t *cache, mem_addr_t row, int i, mem_addr_t block)
+{
+  cache->rrpv[row * cache->E + i] = (drawSet(cache, row, block) % 32 == 0) ? RRPV_MAX - 1 : RRPV_MAX;
+}
+
+static int rripVictim(cache_t *cache, mem_addr_t row, mem_addr_t block)
+{
+  uint8_t *rrpv = &cache->rrpv[row * cache->E];
+  uint8_t oldest = 0;
+  int victim = 0;
+
+  (void) block;
+  for(int i = 0; i < cache->E; i++) { //the first line at the highest value
+    if(rrpv[i] > oldest) {
+      oldest = rrpv[i];
+      victim = i;
+      if(oldest == RRPV_MAX) {
+        return i;
+      }
+    }
+  }
+
+  for(int i = 0; i < cache->E; i++) { //age the set until that line is at RRPV_MAX
+    rrpv[i] += RRPV_MAX - oldest;
+  }
+  return victim;
+}
+
+static void beladyHit(cache_t *cache, mem_addr_t row, int i)
+{
+  cache->next_use[row * cache->E + i] = cache->upcoming;
+}
+
+static void beladyFill(cache_t *cache, mem_addr_t row, int i, mem_addr_t block)
+{
+  (void) block;
+  beladyHit(cache, row, i);
+}
+
+static int beladyVictim(cache_t *cache, mem_addr_t row, mem_addr_t block)
+{
+  const uint32_t *next_use = &cache->next_use[row * cache->E];
+  int victim = 0;
+
+  (void) block;
+  for(int i = 1; i < cache->E; i++) {
+    if(next_use[i] > next_use[victim]) {
+      victim = i;
+    }
+  }
+  return victim;
+}
+
+const policy_t policies[] = {
+  { "lru", touchLine, lruFill, lruVictim, unlinkLine, 0 },
+  { "plru", plruHit, plruFill, plruVictim, noHit, POLICY_TREE | POLICY_POW2 },
+  { "fifo", noHit, lruFill, lruVictim, unlinkLine, 0 },
+  { "random", noHit, noFill, randomVictim, noHit, POLICY_DRAWS },
+  { "srrip", rripHit, srripFill, rripVictim, noHit, POLICY_RRPV },
+  { "brrip", rripHit, brripFill, rripVictim, noHit, POLICY_RRPV | POLICY_DRAWS },
+  { "opt", beladyHit, beladyFill, beladyVictim, noHit, POLICY_NEXT_USE | POLICY_OFFLINE },
+};
+
+#define NUM_POLICIES ((int) (sizeof(policies) / sizeof(policies[0])))
+
+/*
+ * findPolicy - Return the index of the policy called name, or -1
+ */
+int findPolicy(const char *name)
+{
+  for(int i = 0; i < NUM_POLICIES; i++) {
+    if(strcmp(policies[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/*
+ * policyHit, policyFill, policyVictim - Call the cache's policy hooks. LRU,
+ * the default, is called directly, so it pays for no indirect calls.
+ */
+static inline void policyHit(cache_t *cache, mem_addr_t row, int i)
+{
+  if(cache->policy == &policies[0]) {
+    touchLine(cache, row, i);
+  } else {
+    cache->policy->hit(cache, row, i);
+  }
+}
+
+static inline void policyFill(cache_t *cache, mem_addr_t row, int i, mem_addr_t block)
+{
+  if(cache->policy == &policies[0]) {
+    touchLine(cache, row, i);
+  } else {
+    cache->policy->fill(cache, row, i, block);
+  }
+}
+
+static inline int policyVictim(cache_t *cache, mem_addr_t row, mem_addr_t block)
+{
+  if(cache->policy == &policies[0]) {
+    return cache->lru[row];
+  }
+  return cache->policy->victim(cache, row, block);
+}
+
+/*
+ * accessData - Access data at memory address addr
+ *   If it is already in cache, increase the hit count
+ *   If it is not in cache, bring it in cache, increase miss count.
+ *   Also increase the eviction count if a line is evicted.
+ */
+void accessData(cache_t *cache, mem_addr_t addr)
+{
+  mem_addr_t block = addr >> cache->b;      //block number, tag and set based on b, s, and S
+  mem_addr_t tag = block >> cache->s;
+  mem_addr_t set = block & (cache->S - 1);
+  mem_addr_t row = set >> cache->shard_bits; //where this cache keeps the set
+
+  int i = findLine(cache, row, block, tag);
+
+  if(i != -1) { //hit: under LRU the line becomes the most recently used
+    cache->hits++;
+    policyHit(cache, row, i);
+    return;
+  }
+
+  cache->misses++; //update miss count
+
+  i = findFree(cache, row);
+  if(i != -1) { //fill a line that isn't in use
+    cache->valid[row * cache->valid_words + i / 64] |= (uint64_t) 1 << (i % 64);
+    cache->prev[row * cache->E + i] = NO_LINE;
+  } else {      //otherwise evict the line the policy picks
+    i = policyVictim(cache, row, block);
+    cache->evictions++;
+    if(cache->lookup.slots != NULL) {
+      lookupRemove(&cache->lookup, cache->tags[row * cache->stride + i] << cache->s | set);
+    }
+  }
+
+  cache->tags[row * cache->stride + i] = tag;
+  if(cache->lookup.slots != NULL) {
+    lookupInsert(&cache->lookup, block, i);
+  }
+  policyFill(cache, row, i, block);
+}
+
+/*
+ * Block-level primitives for the hierarchy, which also keeps dirty bits.
+ * accessData above stays the lean path for a single cache, whose lines are
+ * never dirty.
+ */
+
+
+/*
+ * cacheLookup - Return the line holding block, or -1 if it isn't cached. A
+ * line that is found counts as used by the replacement policy if touch is set.
+ */
+static int cacheLookup(cache_t *cache, mem_addr_t block, int touch)
+{
+  mem_addr_t row = (block & (cache->S - 1)) >> cache->shard_bits; //where this cache keeps the set
+  int i = findLine(cache, row, block, block >> cache->s);
+
+  if(i != -1 && touch) {
+    policyHit(cache, row, i);
+  }
+  return i;
+}
+
+/*
+ * cacheInstall - Bring block, which must not be cached, into a line, marked
+ * dirty if dirty is set. If that evicts another block, returns 1 and sets
+ * *victim and *victim_dirty; otherwise returns 0.
+ */
+static int cacheInstall(cache_t *cache, mem_addr_t block, int dirty, mem_addr_t *victim, int *victim_dirty)
+{
+  mem_addr_t set = block & (cache->S - 1);
+  mem_addr_t row = set >> cache->shard_bits;
+  uint64_t *valid = &cache->valid[row * cache->valid_words];
+  uint64_t *dirt = &cache->dirty[row * cache->valid_words];
+  int evicted = 0;
+
+  int i = findFree(cache, row);
+  if(i != -1) { //fill a line that isn't in use
+    valid[i / 64] |= (uint64_t) 1 << (i % 64);
+    cache->prev[row * cache->E + i] = NO_LINE;
+  } else {      //otherwise evict the line the policy picks
+    i = policyVictim(cache, row, block);
+    evicted = 1;
+    *victim = cache->tags[row * cache->stride + i] << cache->s | set;
+    *victim_dirty = (dirt[i / 64] >> (i % 64)) & 1;
+    if(cache->lookup.slots != NULL) {
+      lookupRemove(&cache->lookup, *victim);
+    }
+  }
+
+  cache->tags[row * cache->stride + i] = block >> cache->s;
+  dirt[i / 64] = (dirt[i / 64] & ~((uint64_t) 1 << (i % 64))) | (uint64_t) (dirty != 0) << (i % 64);
+  if(cache->lookup.slots != NULL) {
+    lookupInsert(&cache->lookup, block, i);
+  }
+  policyFill(cache, row, i, block);
+  return evicted;
+}
+
+/*
+ * cacheRemove - Invalidate block. Returns -1 if it wasn't cached, or else
+ * whether it was dirty.
+ */
+static int cacheRemove(cache_t *cache, mem_addr_t block)
+{
+  mem_addr_t row = (block & (cache->S - 1)) >> cache->shard_bits;
+  int i = findLine(cache, row, block, block >> cache->s);
+
+  if(i == -1) {
+    return -1;
+  }
+
+  uint64_t bit = (uint64_t) 1 << (i % 64);
+  int dirty = (cache->dirty[row * cache->valid_words + i / 64] & bit) != 0;
+
+  cache->valid[row * cache->valid_words + i / 64] &= ~bit;
+  cache->dirty[row * cache->valid_words + i / 64] &= ~bit;
+  cache->policy->remove(cache, row, i);
+  if(cache->lookup.slots != NULL) {
+    lookupRemove(&cache->lookup, block);
+  }
+  return dirty;
+}
+
+/*
+ * cacheSetDirty - Mark the line holding block (line i, from cacheLookup) dirty
+ */
+static void cacheSetDirty(cache_t *cache, mem_addr_t block, int i)
+{
+  mem_addr_t row = (block & (cache->S - 1)) >> cache->shard_bits;
+
+  cache->dirty[row * cache->valid_words + i / 64] |= (uint64_t) 1 << (i % 64);
+}
+
+
+
+/*
+ * Trace reading
+ *
+ * A trace is parsed straight out of memory: a regular file is mapped whole,
+ * and anything else (a pipe, or the output of a decompressor) is streamed
+ * through a large buffer. gzip and zstd compressed traces are recognized by
+ * their magic number and piped through `gzip -dc` or `zstd -dc`.
+ *
+ * Traces come either in Valgrind's text format or in csim's binary format,
+ * written by `csim -c`:
+ *
+ *   header   "CSIMBIN1", then the maximum records per block (4 bytes)
+ *            and 4 bytes of zeros
+ *   blocks   each a byte length and a record count (4 bytes each), then
+ *            that many records. A record is one byte holding the op (top two
+ *            bits: 0 L, 1 S, 2 M) and the length (low six bits; 63 means a
+ *            varint length follows), then the zigzag varint difference from
+ *            the previous address in the block (from 0 for the first)
+ *   end      a block header of zero length and count
+ *   index    for each block, its file offset and the number of its first
+ *            record (8 bytes each)
+ *   footer   the index's offset, the number of blocks and the number of
+ *            records (8 bytes each), then "CSIMIDX1"
+ *
+ * All integers are little endian. Blocks decode independently, so the index
+ * lets a reader start at any block.
+ */
+
+#define TRACE_BUFFER (1 << 22) //bytes read from a stream at a time
+#define TRACE_BATCH 4096       //records decoded per readTrace call in replayTrace
+
+#define BIN_MAGIC "CSIMBIN1"
+#define BIN_INDEX_MAGIC "CSIMIDX1"
+#define BIN_HEADER 16          //bytes in the file header
+#define BIN_BLOCK_HEADER 8     //bytes in a block header
+#define BIN_FOOTER 32          //bytes in the footer
+#define BIN_BLOCK_RECORDS 65536 //records per block written by writeBinaryTrace
+#define BIN_RECORD_MAX 21      //bytes one record can take
+
+typedef struct access {  //one data access from the trace
+  mem_addr_t addr;
+  unsigned int len;
+  char op;               //'L', 'S' or 'M'
+} access_t;
+
+typedef enum { TRACE_UNKNOWN, TRACE_TEXT, TRACE_BINARY } trace_format_t;
+
+typedef struct trace {
+  int fd;                //the trace file, or the pipe from its decompressor
+  pid_t child;           //the decompressor, or 0
+  char *map;             //the whole file, if it was mapped
+  size_t map_len;
+  char *buf;             //the bytes being parsed: the mapping or a stream buffer
+  size_t cap;            //size of the stream buffer, which has room for one more byte
+  size_t len;            //bytes of data in buf
+  size_t pos;            //next byte to parse
+  size_t end;            //end of the last complete line or block in buf
+  trace_format_t format;
+  int eof;               //no more data will be read into buf
+  int done;              //the end of a binary trace has been parsed
+  int error;             //a read failed, or the trace is corrupt
+  size_t block_left;     //records left in the binary block being decoded
+  mem_addr_t prev_addr;  //the last address decoded from that block
+} trace_t;
+
+/*
+ * get32, get64, put32, put64 - Little endian integers in the binary format
+ */
+static uint32_t get32(const unsigned char *p)
+{
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static uint64_t get64(const unsigned char *p)
+{
+  return get32(p) | (uint64_t) get32(p + 4) << 32;
+}
+
+static void put32(unsigned char *p, uint32_t v)
+{
+  for(int i = 0; i < 4; i++) {
+    p[i] = v >> (8 * i);
+  }
+}
+
+static void put64(unsigned char *p, uint64_t v)
+{
+  put32(p, (uint32_t) v);
+  put32(p + 4, (uint32_t) (v >> 32));
+}
+
+/*
+ * unitEnd - Return the offset just past the last complete line (text) or
+ * block (binary) in buf[start, len), or start if there is none
+ */
+static size_t unitEnd(trace_t *t, size_t start)
+{
+  if(t->format == TRACE_BINARY) {
+    size_t off = start;
+
+    while(off + BIN_BLOCK_HEADER <= t->len) {
+      uint32_t bytes = get32((unsigned char *) t->buf + off);
+      if(get32((unsigned char *) t->buf + off + 4) == 0) { //the end marker is a unit of its own
+        return off + BIN_BLOCK_HEADER;
+      }
+      if(off + BIN_BLOCK_HEADER + bytes > t->len) {
+        break;
+      }
+      off += BIN_BLOCK_HEADER + bytes;
+    }
+    return off;
+  }
+
+  size_t len = t->len;
+  while(len > start && t->buf[len - 1] != '\n') {
+    len--;
+  }
+  return len;
+}
+
+/*
+ * detectFormat - Set the trace's format from its first bytes, at buf[pos], and
+ * skip the binary header
+ */
+static void detectFormat(trace_t *t)
+{
+  if(t->len - t->pos >= BIN_HEADER && memcmp(t->buf + t->pos, BIN_MAGIC, 8) == 0) {
+    t->format = TRACE_BINARY;
+    t->pos += BIN_HEADER;
+  } else {
+    t->format = TRACE_TEXT;
+  }
+}
+
+/*
+ * startDecompressor - Replace t->fd with a pipe from `tool -dc` reading the file
+ */
+static int startDecompressor(trace_t *t, const char *tool)
+{
+  int fds[2];
+
+  if(pipe(fds) != 0) {
+    return -1;
+  }
+
+  pid_t pid = fork();
+  if(pid == -1) {
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+
+  if(pid == 0) { //the file becomes the decompressor's stdin and the pipe its stdout
+    dup2(t->fd, STDIN_FILENO);
+    dup2(fds[1], STDOUT_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    close(t->fd);
+    execlp(tool, tool, "-dc", (char *) NULL);
+    _exit(127);
+  }
+
+  close(fds[1]);
+  close(t->fd);
+  t->fd = fds[0];
+  t->child = pid;
+  return 0;
+}
+
+/*
+ * openTrace - Open a trace for readTrace. Returns 0, or -1 if it can't be read.
+ */
+int openTrace(trace_t *t, const char *trace_fn)
+{
+  struct stat st;
+  unsigned char magic[4] = {0};
+
+  memset(t, 0, sizeof(*t));
+  t->fd = open(trace_fn, O_RDONLY);
+  if(t->fd == -1 || fstat(t->fd, &st) != 0) {
+    return -1;
+  }
+
+  if(S_ISREG(st.st_mode) && pread(t->fd, magic, sizeof(magic), 0) == sizeof(magic)) {
+    const char *tool = NULL;
+
+    if(magic[0] == 0x1f && magic[1] == 0x8b) {
+      tool = "gzip";
+    } else if(magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+      tool = "zstd";
+    }
+
+    if(tool == NULL) { //uncompressed: map it if we can
+      t->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, t->fd, 0);
+      if(t->map != MAP_FAILED) {
+        madvise(t->map, st.st_size, MADV_SEQUENTIAL);
+        t->map_len = st.st_size;
+        t->buf = t->map;
+        t->len = st.st_size;
+        t->eof = 1;
+        detectFormat(t);
+        t->end = unitEnd(t, t->pos);
+        return 0;
+      }
+      t->map = NULL;
+    } else if(startDecompressor(t, tool) != 0) {
+      return -1;
+    }
+  }
+
+  t->cap = TRACE_BUFFER; //stream whatever couldn't be mapped
+  t->buf = malloc(t->cap + 1);
+  return (t->buf == NULL) ? -1 : 0;
+}
+
+/*
+ * fillTrace - Make more complete lines or blocks available in t->buf once the
+ * ones there have been parsed. Returns 0 at the end of the trace.
+ */
+static int fillTrace(trace_t *t)
+{
+  size_t rest = t->len - t->end; //an incomplete line or block left at the end
+
+  if(t->done) {
+    return 0;
+  }
+
+  if(t->buf == t->map && t->map != NULL) { //the mapping is exhausted
+    if(rest == 0 || t->format == TRACE_BINARY) {
+      t->error |= (t->format == TRACE_BINARY); //a binary trace ends with its end marker
+      return 0;
+    }
+
+    char *tail = malloc(rest + 1); //a text trace's last line may be unterminated
+    if(tail == NULL) {
+      t->error = 1;
+      return 0;
+    }
+    memcpy(tail, t->buf + t->end, rest);
+    tail[rest] = '\n';
+    t->buf = tail;
+    t->len = t->end = rest + 1;
+    t->pos = 0;
+    return 1;
+  }
+
+  if(t->eof) {
+    t->error |= (rest > 0 && t->format == TRACE_BINARY); //truncated
+    if(rest == 0 || t->format == TRACE_BINARY) {
+      return 0;
+    }
+  }
+
+  memmove(t->buf, t->buf + t->end, rest); //keep the incomplete unit and read after it
+  t->len = rest;
+  t->pos = 0;
+
+  while(!t->eof && t->len < t->cap) {
+    ssize_t n = read(t->fd, t->buf + t->len, t->cap - t->len);
+    if(n > 0) {
+      t->len += n;
+    } else if(n == 0 || errno != EINTR) {
+      t->eof = 1;
+      t->error |= (n < 0);
+    }
+  }
+
+  if(t->format == TRACE_UNKNOWN) {
+    detectFormat(t);
+  }
+
+  if(t->format == TRACE_TEXT && t->eof && t->len > 0 && t->buf[t->len - 1] != '\n') { //terminate the last line of the trace
+    t->buf[t->len++] = '\n';
+  }
+
+  t->end = unitEnd(t, t->pos);
+  if(t->end == t->pos && t->len > t->pos) { //a unit bigger than the whole buffer
+    if(t->format == TRACE_BINARY) {
+      t->error = 1;
+      return 0;
+    }
+    t->end = t->len;                        //a "line" that long isn't a record: drop it
+    t->pos = t->len;
+  }
+  return t->pos < t->end || !t->eof;
+}
+
+/*
+ * parseHex, parseDec - Hand-written number parsers for the address and length
+ * of a text record. Every line being parsed ends in a newline, which stops them.
+ */
+static const char *parseHex(const char *p, mem_addr_t *value)
+{
+  mem_addr_t v = 0;
+
+  for(;; p++) {
+    unsigned c = (unsigned char) *p;
+    if(c - '0' < 10) {
+      v = v << 4 | (c - '0');
+    } else if((c | 0x20) - 'a' < 6) {
+      v = v << 4 | ((c | 0x20) - 'a' + 10);
+    } else {
+      break;
+    }
+  }
+  *value = v;
+  return p;
+}
+
+static const char *parseDec(const char *p, unsigned int *value)
+{
+  unsigned int v = 0;
+
+  for(; (unsigned) ((unsigned char) *p - '0') < 10; p++) {
+    v = v * 10 + (*p - '0');
+  }
+  *value = v;
+  return p;
+}
+
+/*
+ * parseText - Decode up to max records from the complete lines in t->buf
+ */
+static size_t parseText(trace_t *t, access_t *out, size_t max)
+{
+  const char *p = t->buf + t->pos;
+  const char *end = t->buf + t->end;
+  size_t n = 0;
+
+  while(p < end && n < max) {
+    if(p[0] == ' ' && (p[1] == 'L' || p[1] == 'S' || p[1] == 'M') && p[2] == ' ') {
+      const char *q = p + 3;
+      while(*q == ' ') {
+        q++;
+      }
+      q = parseHex(q, &out[n].addr);
+      out[n].len = 0;
+      if(*q == ',') {
+        q = parseDec(q + 1, &out[n].len);
+      }
+      out[n].op = p[1];
+      n++;
+      p = q;
+    }
+    p = (const char *) memchr(p, '\n', end - p) + 1; //on to the next line
+  }
+
+  t->pos = p - t->buf;
+  return n;
+}
+
+/*
+ * getVarint - Decode an LEB128 varint, not reading past end
+ */
+static const unsigned char *getVarint(const unsigned char *p, const unsigned char *end, uint64_t *value)
+{
+  uint64_t v = 0;
+
+  for(int shift = 0; p < end && shift < 64; shift += 7) {
+    v |= (uint64_t) (*p & 0x7f) << shift;
+    if(!(*p++ & 0x80)) {
+      break;
+    }
+  }
+  *value = v;
+  return p;
+}
+
+/*
+ * parseBinary - Decode up to max records from the complete blocks in t->buf
+ */
+static size_t parseBinary(trace_t *t, access_t *out, size_t max)
+{
+  const unsigned char *p = (unsigned char *) t->buf + t->pos;
+  const unsigned char *end = (unsigned char *) t->buf + t->end;
+  size_t n = 0;
+
+  while(n < max && p < end) {
+    if(t->block_left == 0) { //start the next block
+      t->block_left = get32(p + 4);
+      t->prev_addr = 0;
+      p += BIN_BLOCK_HEADER;
+      if(t->block_left == 0) {
+        t->done = 1;
+        break;
+      }
+    }
+
+    uint64_t len = *p & 63, delta;
+    out[n].op = "LSM?"[*p++ >> 6];
+    if(len == 63) {
+      p = getVarint(p, end, &len);
+    }
+    p = getVarint(p, end, &delta);
+
+    t->prev_addr += (delta >> 1) ^ -(delta & 1); //undo the zigzag encoding
+    out[n].addr = t->prev_addr;
+    out[n].len = (unsigned int) len;
+    n++;
+    t->block_left--;
+  }
+
+  t->pos = (char *) p - t->buf;
+  return n;
+}
+
+/*
+ * readTrace - Decode up to max data accesses from the trace into out. Text
+ * lines not starting with ` S`, ` L` or ` M` are skipped. Returns the number
+ * decoded, which is 0 only at the end of the trace.
+ */
+size_t readTrace(trace_t *t, access_t *out, size_t max)
+{
+  size_t n = 0;
+
+  while(n < max) {
+    if(t->pos == t->end && !fillTrace(t)) {
+      break;
+    }
+
+    n += (t->format == TRACE_BINARY) ? parseBinary(t, out + n, max - n) : parseText(t, out + n, max - n);
+  }
+
+  return n;
+}
+
+/*
+ * skipTrace - Skip the next n records of the trace. In a mapped binary trace
+ * this jumps through the block index; otherwise the records are decoded and
+ * dropped. Returns the number skipped.
+ */
+size_t skipTrace(trace_t *t, size_t n)
+{
+  static access_t scratch[TRACE_BATCH];
+  size_t skipped = 0;
+
+  if(t->format == TRACE_BINARY && t->buf == t->map && t->block_left == 0 && t->map_len >= BIN_HEADER + BIN_FOOTER) {
+    const unsigned char *footer = (unsigned char *) t->map + t->map_len - BIN_FOOTER;
+    uint64_t index = get64(footer), blocks = get64(footer + 8);
+
+    if(memcmp(footer + 24, BIN_INDEX_MAGIC, 8) == 0 && index + blocks * 16 <= t->map_len - BIN_FOOTER) {
+      const unsigned char *entry = (unsigned char *) t->map + index;
+      uint64_t lo = 0, hi = blocks;   //find the last block starting at or before record n
+      while(hi - lo > 1) {
+        uint64_t mid = (lo + hi) / 2;
+        if(get64(entry + 16 * mid + 8) <= n) {
+          lo = mid;
+        } else {
+          hi = mid;
+        }
+      }
+      if(blocks > 0 && get64(entry + 16 * lo + 8) <= n && get64(entry + 16 * lo) < t->end) {
+        t->pos = get64(entry + 16 * lo);
+        skipped = get64(entry + 16 * lo + 8);
+      }
+    }
+  }
+
+  while(skipped < n) { //the rest of the way record by record
+    size_t got = readTrace(t, scratch, (n - skipped < TRACE_BATCH) ? n - skipped : TRACE_BATCH);
+    if(got == 0) {
+      break;
+    }
+    skipped += got;
+  }
+
+  return skipped;
+}
+
+/*
+ * closeTrace - Release a trace. Returns 0, or -1 if it could not be read in
+ * full (including the decompressor failing).
+ */
+int closeTrace(trace_t *t)
+{
+  int status = 0;
+
+  if(t->map != NULL) {
+    munmap(t->map, t->map_len);
+  }
+  if(t->buf != t->map) {
+    free(t->buf);
+  }
+  if(t->fd != -1) {
+    close(t->fd);
+  }
+  if(t->child != 0 && (waitpid(t->child, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+    t->error = 1;
+  }
+
+  return t->error ? -1 : 0;
+}
+
+/*
+ * putVarint - Encode an LEB128 varint, returning the byte after it
+ */
+static unsigned char *putVarint(unsigned char *p, uint64_t v)
+{
+  while(v >= 0x80) {
+    *p++ = (unsigned char) (v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (unsigned char) v;
+  return p;
+}
+
+/*
+ * writeBinaryTrace - Convert the trace trace_fn (in any format openTrace reads)
+ * to csim's binary format in out_fn. Returns 0, or -1 on failure.
+ */
+int writeBinaryTrace(const char *trace_fn, const char *out_fn)
+{
+  static access_t batch[TRACE_BATCH];
+  static unsigned char block[BIN_BLOCK_HEADER + BIN_BLOCK_RECORDS * BIN_RECORD_MAX];
+  unsigned char word[BIN_FOOTER];
+  trace_t trace;
+  uint64_t *index = NULL;     //offset and first record of each block
+  size_t blocks = 0, index_cap = 0;
+  uint64_t records = 0, offset = BIN_HEADER;
+  int failed = 0;
+  size_t n;
+
+  if(openTrace(&trace, trace_fn) != 0) {
+    printf("%s\n", "Error opening file");
+    return -1;
+  }
+
+  FILE *out = fopen(out_fn, "wb");
+  if(out == NULL) {
+    printf("%s\n", "Error creating binary trace");
+    closeTrace(&trace);
+    return -1;
+  }
+
+  memcpy(word, BIN_MAGIC, 8);
+  put32(word + 8, BIN_BLOCK_RECORDS);
+  put32(word + 12, 0);
+  failed |= fwrite(word, BIN_HEADER, 1, out) != 1;
+
+  unsigned char *p = block + BIN_BLOCK_HEADER;
+  uint32_t count = 0;
+  mem_addr_t prev = 0;
+
+  do {
+    n = readTrace(&trace, batch, TRACE_BATCH);
+
+    for(size_t i = 0; i <= n; i++) {
+      if(count == BIN_BLOCK_RECORDS || (i == n && n == 0 && count > 0)) { //flush a full block, or the last one
+        if(blocks == index_cap) {
+          index_cap = index_cap ? 2 * index_cap : 1024;
+          uint64_t *grown = realloc(index, index_cap * 2 * sizeof(uint64_t));
+          if(grown == NULL) {
+            failed = 1;
+            break;
+          }
+          index = grown;
+        }
+        index[2 * blocks] = offset;
+        index[2 * blocks + 1] = records - count;
+        blocks++;
+
+        put32(block, (uint32_t) (p - block - BIN_BLOCK_HEADER));
+        put32(block + 4, count);
+        failed |= fwrite(block, p - block, 1, out) != 1;
+        offset += p - block;
+
+        p = block + BIN_BLOCK_HEADER;
+        count = 0;
+        prev = 0;
+      }
+      if(i == n) {
+        break;
+      }
+
+      unsigned int op = (batch[i].op == 'L') ? 0 : (batch[i].op == 'S') ? 1 : 2;
+      uint64_t delta = batch[i].addr - prev;
+
+      *p++ = (unsigned char) (op << 6 | (batch[i].len < 63 ? batch[i].len : 63));
+      if(batch[i].len >= 63) {
+        p = putVarint(p, batch[i].len);
+      }
+      p = putVarint(p, delta << 1 ^ -(delta >> 63)); //zigzag, so small backward steps stay small
+      prev = batch[i].addr;
+      count++;
+      records++;
+    }
+  } while(n > 0 && !failed);
+
+  memset(word, 0, BIN_BLOCK_HEADER); //end marker
+  failed |= fwrite(word, BIN_BLOCK_HEADER, 1, out) != 1;
+
+  for(size_t i = 0; i < 2 * blocks; i++) {
+    put64(word, index[i]);
+    failed |= fwrite(word, 8, 1, out) != 1;
+  }
+
+  put64(word, offset + BIN_BLOCK_HEADER);
+  put64(word + 8, blocks);
+  put64(word + 16, records);
+  memcpy(word + 24, BIN_INDEX_MAGIC, 8);
+  failed |= fwrite(word, BIN_FOOTER, 1, out) != 1;
+
+  free(index);
+  failed |= fclose(out) != 0;
+  if(closeTrace(&trace) != 0) {
+    printf("%s\n", "Error reading file");
+    return -1;
+  }
+  if(failed) {
+    printf("%s\n", "Error writing binary trace");
+    return -1;
+  }
+  return 0;
+}
+
+
+/*
+ * lastBlock - The last block an access touches: its first one unless the size
+ * is honored (-l)
+ */
+static mem_addr_t lastBlock(const access_t *access, int b)
+{
+  if(!honor_len || access->len <= 1) {
+    return access->addr >> b;
+  }
+  return (access->addr + access->len - 1) >> b;
+}
+
+/*
+ * simulate - Run a batch of accesses against a cache, a data modify (M) being
+ * a load followed by a store to the same address
+ */
+static void simulate(cache_t *cache, const access_t *batch, size_t n)
+{
+  for(size_t i = 0; i < n; i++) {
+    mem_addr_t last = lastBlock(&batch[i], cache->b);
+
+    if(!honor_len || last == batch[i].addr >> cache->b) {
+      accessData(cache, batch[i].addr);
+
+      if(batch[i].op == 'M') {
+        accessData(cache, batch[i].addr);
+      }
+      continue;
+    }
+
+    for(int pass = (batch[i].op == 'M') ? 2 : 1; pass > 0; pass--) {
+      for(mem_addr_t block = batch[i].addr >> cache->b; block <= last; block++) {
+        accessData(cache, block << cache->b);
+      }
+    }
+  }
+}
+
+
+/*
+ * Cache hierarchy (-L, -i, -w, -a)
+ *
+ * A demand access starts at L1 and goes down a level on each miss. Under the
+ * default non-inclusive non-exclusive (NINE) policy a miss fetches the block
+ * from the level below, which installs it too, and a dirty victim is written
+ * back to the level below. An inclusive hierarchy also invalidates a victim in
+ * every level above (picking up any dirty copy), so the levels above always
+ * hold a subset. In an exclusive one a block lives in at most one level: a hit
+ * below L1 moves the block up to L1, and victims move down a level at a time.
+ *
+ * Only demand loads and stores count as hits and misses at a level; write-back
+ * traffic between levels only shows in the evictions it causes.
+ */
+
+enum { OP_READ, OP_WRITE, OP_WRITEBACK };
+
+static void levelAccess(hierarchy_t *h, int k, mem_addr_t block, int op);
+
+/*
+ * levelInstall - Install block at level k, handling its victim
+ */
+static void levelInstall(hierarchy_t *h, int k, mem_addr_t block, int dirty)
+{
+  cache_t *c = &h->level[k];
+  mem_addr_t victim;
+  int victim_dirty;
+
+  if(!cacheInstall(c, block, dirty, &victim, &victim_dirty)) {
+    return;
+  }
+  c->evictions++;
+
+  if(inclusion == INCLUSION_INCLUSIVE) { //back-invalidate the copies above
+    for(int j = 0; j < k; j++) {
+      if(cacheRemove(&h->level[j], victim) == 1) {
+        victim_dirty = 1;
+      }
+    }
+  }
+
+  if(victim_dirty) {
+    c->dirty_evictions++;
+    levelAccess(h, k + 1, victim, OP_WRITEBACK);
+  }
+}
+
+/*
+ * levelAccess - Perform a read, write or write-back of block at level k of a
+ * NINE or inclusive hierarchy, level h->levels being memory
+ */
+static void levelAccess(hierarchy_t *h, int k, mem_addr_t block, int op)
+{
+  if(k == h->levels) {
+    if(op == OP_READ) {
+      h->mem_reads++;
+    } else {
+      h->mem_writes++;
+    }
+    return;
+  }
+
+  cache_t *c = &h->level[k];
+  int i = cacheLookup(c, block, 1);
+
+  if(i != -1) {
+    c->hits += (op != OP_WRITEBACK);
+    if(op != OP_READ) {
+      if(write_back) {
+        cacheSetDirty(c, block, i);
+      } else {
+        levelAccess(h, k + 1, block, OP_WRITE);
+      }
+    }
+    return;
+  }
+
+  if(op == OP_WRITEBACK) { //the whole block is written, so nothing is fetched
+    if(write_back) {
+      levelInstall(h, k, block, 1);
+    } else {
+      levelAccess(h, k + 1, block, OP_WRITE);
+    }
+    return;
+  }
+
+  c->misses++;
+  if(op == OP_WRITE && !write_allocate) {
+    levelAccess(h, k + 1, block, OP_WRITE);
+    return;
+  }
+
+  levelAccess(h, k + 1, block, OP_READ);
+  levelInstall(h, k, block, op == OP_WRITE && write_back);
+  if(op == OP_WRITE && !write_back) {
+    levelAccess(h, k + 1, block, OP_WRITE);
+  }
+}
+
+/*
+ * exclusiveAccess - Perform a demand read or write of block in an exclusive
+ * hierarchy
+ */
+static void exclusiveAccess(hierarchy_t *h, mem_addr_t block, int op)
+{
+  int i = cacheLookup(&h->level[0], block, 1);
+  int dirty = 0;
+  int k;
+
+  if(i != -1) {
+    h->level[0].hits++;
+    if(op == OP_WRITE) {
+      if(write_back) {
+        cacheSetDirty(&h->level[0], block, i);
+      } else {
+        h->mem_writes++;
+      }
+    }
+    return;
+  }
+  h->level[0].misses++;
+
+  for(k = 1; k < h->levels; k++) { //look for the one copy further down
+    i = cacheLookup(&h->level[k], block, op == OP_WRITE && !write_allocate);
+    if(i != -1) {
+      h->level[k].hits++;
+      break;
+    }
+    h->level[k].misses++;
+  }
+
+  if(op == OP_WRITE && !write_allocate) { //update the block where it is
+    if(k < h->levels && write_back) {
+      cacheSetDirty(&h->level[k], block, i);
+    } else {
+      h->mem_writes++;
+    }
+    return;
+  }
+
+  if(k < h->levels) {
+    dirty = cacheRemove(&h->level[k], block);
+  } else {
+    h->mem_reads++;
+  }
+  if(op == OP_WRITE) {
+    if(write_back) {
+      dirty = 1;
+    } else {
+      h->mem_writes++;
+    }
+  }
+
+  for(k = 0; k < h->levels; k++) { //each victim moves down a level
+    mem_addr_t victim;
+    int victim_dirty;
+
+    if(!cacheInstall(&h->level[k], block, dirty, &victim, &victim_dirty)) {
+      return;
+    }
+    h->level[k].evictions++;
+    h->level[k].dirty_evictions += victim_dirty;
+    block = victim;
+    dirty = victim_dirty;
+  }
+  h->mem_writes += dirty; //off the bottom level
+}
+
+/*
+ * hierarchyAccess - Perform a demand read or write of block
+ */
+static void hierarchyAccess(hierarchy_t *h, mem_addr_t block, int op)
+{
+  if(inclusion == INCLUSION_EXCLUSIVE) {
+    exclusiveAccess(h, block, op);
+  } else {
+    levelAccess(h, 0, block, op);
+  }
+}
+
+/*
+ * simulateHierarchy - Run a batch of accesses against a hierarchy
+ */
+static void simulateHierarchy(hierarchy_t *h, const access_t *batch, size_t n)
+{
+  int b = h->level[0].b;
+
+  for(size_t i = 0; i < n; i++) {
+    mem_addr_t first = batch[i].addr >> b;
+    mem_addr_t last = lastBlock(&batch[i], b);
+
+    if(batch[i].op != 'S') {
+      for(mem_addr_t block = first; block <= last; block++) {
+        hierarchyAccess(h, block, OP_READ);
+      }
+    }
+    if(batch[i].op != 'L') {
+      for(mem_addr_t block = first; block <= last; block++) {
+        hierarchyAccess(h, block, OP_WRITE);
+      }
+    }
+  }
+}
+
+/*
+ * replayBatch - Run a batch of accesses against the hierarchy, or just its L1
+ * if there is nothing more to model
+ */
+static void replayBatch(hierarchy_t *h, const access_t *batch, size_t n)
+{
+  if(hierarchy_mode) {
+    simulateHierarchy(h, batch, n);
+  } else {
+    simulate(&h->level[0], batch, n);
+  }
+}
+
+/*
+ * initHierarchy - Set up the cache given by s, E and b and the levels under it,
+ * each holding only the sets of one shard as in initCache. Returns 0, or -1 if
+ * out of memory.
+ */
+int initHierarchy(hierarchy_t *h, int shard_bits)
+{
+  memset(h, 0, sizeof(*h));
+  for(h->levels = 0; h->levels < levels; h->levels++) {
+    int k = h->levels;
+    if(initCache(&h->level[k], k ? level_s[k] : s, k ? level_E[k] : E, b, shard_bits, &policies[replacement]) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * freeHierarchy - free each level
+ */
+void freeHierarchy(hierarchy_t *h)
+{
+  for(int k = 0; k < h->levels; k++) {
+    freeCache(&h->level[k]);
+  }
+}
+
+/*
+ * addHierarchy - Add the statistics of one hierarchy into another's
+ */
+static void addHierarchy(hierarchy_t *to, const hierarchy_t *from)
+{
+  for(int k = 0; k < to->levels; k++) {
+    to->level[k].hits += from->level[k].hits;
+    to->level[k].misses += from->level[k].misses;
+    to->level[k].evictions += from->level[k].evictions;
+    to->level[k].dirty_evictions += from->level[k].dirty_evictions;
+  }
+  to->mem_reads += from->mem_reads;
+  to->mem_writes += from->mem_writes;
+}
+
+/*
+ * printHierarchy - Print the statistics of each level and of memory
+ */
+void printHierarchy(const hierarchy_t *h)
+{
+  for(int k = 0; k < h->levels; k++) {
+    const cache_t *c = &h->level[k];
+    printf("L%d hits:%lu misses:%lu evictions:%lu dirty_evictions:%lu\n", k + 1,
+           c->hits, c->misses, c->evictions, c->dirty_evictions);
+  }
+  printf("memory reads:%lu writes:%lu\n", h->mem_reads, h->mem_writes);
+}
+
+/*
+ * replayTrace - replays the given trace file against the cache
+ *
+ * Each access decoded by readTrace, after the first skip_records, is passed to
+ * accessData, twice for a data modify (M), or to the hierarchy. Returns 0, or
+ * -1 if the trace couldn't be read.
+ */
+int replayTrace(char* trace_fn)
+{
+    static access_t batch[TRACE_BATCH];
+    trace_t trace;
+    size_t n;
+
+    if(openTrace(&trace, trace_fn) != 0) {
+      printf("%s\n", "Error opening file"); //check if file is valid
+      return -1;
+    }
+
+    skipTrace(&trace, skip_records);
+
+    while((n = readTrace(&trace, batch, TRACE_BATCH)) > 0) {
+      replayBatch(&hierarchy, batch, n);
+    }
+
+    if(closeTrace(&trace) != 0) {
+      printf("%s\n", "Error reading file");
+      return -1;
+    }
+    return 0;
+}
+
+/*
+ * beladyTrace - replays the given trace file against the cache under Belady's
+ * policy
+ *
+ * The accesses after the first skip_records are read in full and expanded
+ * into the blocks they touch, as simulate does, then scanned backwards for
+ * when each block is next used, and replayed with that time at hand. This
+ * takes 12 bytes per access and is limited to INT_MAX of them. Returns 0, or
+ * -1 on failure.
+ */
+int beladyTrace(char* trace_fn, cache_t *cache)
+{
+  static access_t batch[TRACE_BATCH];
+  trace_t trace;
+  mem_addr_t *blocks = NULL;
+  uint32_t *next = NULL;
+  size_t count = 0, cap = 0, distinct = 0;
+  lookup_t last = { NULL, 0 }; //latest access to each block seen so far, scanning backwards
+  int result = 0;
+  size_t n;
+
+  if(openTrace(&trace, trace_fn) != 0) {
+    printf("%s\n", "Error opening file");
+    return -1;
+  }
+  skipTrace(&trace, skip_records);
+
+  while(result == 0 && (n = readTrace(&trace, batch, TRACE_BATCH)) > 0) {
+    for(size_t i = 0; i < n && result == 0; i++) {
+      mem_addr_t end = lastBlock(&batch[i], cache->b);
+      for(int pass = (batch[i].op == 'M') ? 2 : 1; pass > 0 && result == 0; pass--) {
+        for(mem_addr_t block = batch[i].addr >> cache->b; block <= end; block++) {
+          if(count == cap) {
+            mem_addr_t *grown = (cap < INT_MAX) ? realloc(blocks, (cap ? 2 * cap : 1 << 16) * sizeof(mem_addr_t)) : NULL;
+            if(grown == NULL) {
+              result = -1;
+              break;
+            }
+            blocks = grown;
+            cap = cap ? 2 * cap : 1 << 16;
+          }
+          blocks[count++] = block;
+        }
+      }
+    }
+  }
+
+  if(closeTrace(&trace) != 0) {
+    printf("%s\n", "Error reading file");
+    free(blocks);
+    return -1;
+  }
+
+  next = malloc((count ? count : 1) * sizeof(uint32_t));
+  if(result != 0 || next == NULL || lookupGrow(&last) != 0) {
+    result = -1;
+  }
+
+  for(size_t i = count; result == 0 && i-- > 0;) {
+    struct slot *slot = lookupFind(&last, blocks[i]);
+    if(slot != NULL) {
+      next[i] = (uint32_t) slot->value;
+      slot->value = (int) i;
+      continue;
+    }
+    next[i] = NEVER;
+    if(2 * (distinct + 1) > last.mask + 1 && lookupGrow(&last) != 0) {
+      result = -1;
+      break;
+    }
+    lookupInsert(&last, blocks[i], (int) i);
+    distinct++;
+  }
+
+  if(result != 0) {
+    printf("%s\n", "Error allocating memory for the trace");
+  }
+
+  for(size_t i = 0; result == 0 && i < count; i++) {
+    cache->upcoming = next[i];
+    accessData(cache, blocks[i] << cache->b);
+  }
+
+  free(last.slots);
+  free(next);
+  free(blocks);
+  return result;
+}
+
+/*
+ * Sweep mode (-x)
+ *
+ * Many cache geometries are simulated in one pass over the trace. The main
+ * thread decodes the trace into one of two batch buffers while the workers run
+ * the other through their caches; a barrier hands the buffers over. Caches are
+ * dealt out to the workers round robin, and each cache only ever belongs to one
+ * worker, so no locking is needed.
+ */
+
+#define SWEEP_MAX 4096   //most geometries one sweep may simulate
+#define SWEEP_BATCH (1 << 16) //accesses per buffer handed to the workers
+
+typedef struct sweep {
+  cache_t *caches;
+  int ncaches;
+  int workers;
+  access_t *batch[2];    //the buffer being decoded into and the one being simulated
+  size_t count[2];       //accesses in each; 0 ends the sweep
+  pthread_barrier_t barrier;
+} sweep_t;
+
+typedef struct sweep_worker {
+  sweep_t *sweep;
+  int id;
+} sweep_worker_t;
+
+/*
+ * parseRange - Parse "n" or "lo-hi" at *p into [*lo, *hi], advancing *p.
+ * Returns 0, or -1 if it isn't a number or range.
+ */
+static int parseRange(const char **p, int *lo, int *hi)
+{
+  char *end;
+
+  *lo = *hi = (int) strtol(*p, &end, 10);
+  if(end == *p) {
+    return -1;
+  }
+  if(*end == '-') {
+    const char *start = end + 1;
+    *hi = (int) strtol(start, &end, 10);
+    if(end == start || *hi < *lo) {
+      return -1;
+    }
+  }
+  *p = end;
+  return 0;
+}
+
+/*
+ * parseSweep - Parse a sweep specification: a comma-separated list of s:E:b
+ * geometries, each field a number or an inclusive range lo-hi (stepping by one
+ * for s and b, and doubling for E). Fills in up to SWEEP_MAX geometries and
+ * returns how many, or -1 if the specification is malformed.
+ */
+int parseSweep(const char *spec, int geometry[][3])
+{
+  int n = 0;
+  const char *p = spec;
+
+  for(;;) {
+    int lo[3], hi[3];
+
+    for(int f = 0; f < 3; f++) {
+      if(parseRange(&p, &lo[f], &hi[f]) != 0 || lo[f] < (f == 1 ? 1 : 0)) { //E is at least 1
+        return -1;
+      }
+      if(f < 2 && *p++ != ':') {
+        return -1;
+      }
+    }
+
+    for(int gs = lo[0]; gs <= hi[0]; gs++) {
+      for(int gE = lo[1]; gE <= hi[1]; gE *= 2) {
+        for(int gb = lo[2]; gb <= hi[2]; gb++) {
+          if(n == SWEEP_MAX || gE > MAX_E || gs + gb >= ADDRESS_LENGTH) {
+            return -1;
+          }
+          geometry[n][0] = gs;
+          geometry[n][1] = gE;
+          geometry[n][2] = gb;
+          n++;
+        }
+      }
+    }
+
+    if(*p == '\0') {
+      return n;
+    }
+    if(*p++ != ',') {
+      return -1;
+    }
+  }
+}
+
+/*
+ * sweepWorker - Run each batch through the worker's share of the caches
+ */
+static void *sweepWorker(void *arg)
+{
+  sweep_worker_t *worker = arg;
+  sweep_t *sweep = worker->sweep;
+
+  for(int cur = 0;; cur ^= 1) {
+    pthread_barrier_wait(&sweep->barrier); //batch[cur] is ready
+    if(sweep->count[cur] == 0) {
+      break;
+    }
+    for(int i = worker->id; i < sweep->ncaches; i += sweep->workers) {
+      simulate(&sweep->caches[i], sweep->batch[cur], sweep->count[cur]);
+    }
+  }
+  return NULL;
+}
+
+/*
+ * sweepTrace - Simulate every geometry in spec over one pass of the trace with
+ * up to jobs worker threads, and print each one's statistics. Returns 0, or -1
+ * on failure.
+ */
+int sweepTrace(char* trace_fn, const char *spec, int jobs)
+{
+  static int geometry[SWEEP_MAX][3];
+  sweep_t sweep;
+  trace_t trace;
+  int result = 0;
+
+  sweep.ncaches = parseSweep(spec, geometry);
+  if(sweep.ncaches <= 0) {
+    printf("%s\n", "Invalid sweep specification");
+    return -1;
+  }
+
+  sweep.caches = calloc(sweep.ncaches, sizeof(cache_t));
+  sweep.batch[0] = malloc(SWEEP_BATCH * sizeof(access_t));
+  sweep.batch[1] = malloc(SWEEP_BATCH * sizeof(access_t));
+  if(sweep.caches == NULL || sweep.batch[0] == NULL || sweep.batch[1] == NULL) {
+    printf("%s\n", "Error allocating cache");
+    return -1;
+  }
+
+  const policy_t *policy = &policies[replacement];
+  for(int i = 0; i < sweep.ncaches; i++) {
+    if((policy->flags & POLICY_OFFLINE) || ((policy->flags & POLICY_POW2) && (geometry[i][1] & (geometry[i][1] - 1)) != 0)) {
+      printf("-r %s can't simulate s:%d E:%d b:%d in a sweep\n", policy->name, geometry[i][0], geometry[i][1], geometry[i][2]);
+      return -1;
+    }
+  }
+
+  for(int i = 0; i < sweep.ncaches; i++) {
+    if(initCache(&sweep.caches[i], geometry[i][0], geometry[i][1], geometry[i][2], 0, &policies[replacement]) != 0) {
+      printf("%s\n", "Error allocating cache");
+      return -1;
+    }
+  }
+
+  if(openTrace(&trace, trace_fn) != 0) {
+    printf("%s\n", "Error opening file");
+    return -1;
+  }
+  skipTrace(&trace, skip_records);
+
+  sweep.workers = (jobs < sweep.ncaches) ? jobs : sweep.ncaches;
+  pthread_t threads[sweep.workers];
+  sweep_worker_t workers[sweep.workers];
+
+  pthread_barrier_init(&sweep.barrier, NULL, sweep.workers + 1);
+  for(int i = 0; i < sweep.workers; i++) {
+    workers[i].sweep = &sweep;
+    workers[i].id = i;
+    pthread_create(&threads[i], NULL, sweepWorker, &workers[i]);
+  }
+
+  sweep.count[0] = readTrace(&trace, sweep.batch[0], SWEEP_BATCH);
+  for(int cur = 0;; cur ^= 1) {
+    pthread_barrier_wait(&sweep.barrier); //hand batch[cur] to the workers, who are done with the other one
+    if(sweep.count[cur] == 0) {
+      break;
+    }
+    sweep.count[cur ^ 1] = readTrace(&trace, sweep.batch[cur ^ 1], SWEEP_BATCH);
+  }
+
+  for(int i = 0; i < sweep.workers; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  pthread_barrier_destroy(&sweep.barrier);
+
+  if(closeTrace(&trace) != 0) {
+    printf("%s\n", "Error reading file");
+    result = -1;
+  }
+
+  for(int i = 0; i < sweep.ncaches; i++) {
+    cache_t *c = &sweep.caches[i];
+    if(result == 0) {
+      printf("s:%d E:%d b:%d hits:%lu misses:%lu evictions:%lu\n", c->s, c->E, c->b, c->hits, c->misses, c->evictions);
+    }
+    freeCache(c);
+  }
+
+  free(sweep.caches);
+  free(sweep.batch[0]);
+  free(sweep.batch[1]);
+  return result;
+}
+
+
+/*
+ * Set-sharded replay (-p)
+ *
+ * Sets never interact, so one cache can be simulated by several workers that
+ * each own the sets whose low index bits are their number: each worker has a
+ * cache_t holding only its shard. The main thread decodes the trace, deals the
+ * accesses out by set into per-worker batches, and passes full batches to each
+ * worker over a single-producer single-consumer queue; the worker hands the
+ * batch back on a second queue once it is simulated. Each set still sees its
+ * accesses in trace order, so the merged counts equal a sequential run's.
+ */
+
+#define SHARD_BATCH 4096 //accesses per batch
+#define SHARD_QUEUE 16   //batches in flight per worker, a power of two
+
+typedef struct shard_batch {
+  size_t n;              //accesses in the batch; 0 tells the worker to stop
+  access_t access[SHARD_BATCH];
+} shard_batch_t;
+
+/*
+ * A lock-free single-producer single-consumer queue of batches. The producer
+ * only writes tail and the consumer only writes head, each on its own host
+ * cache line.
+ */
+typedef struct spsc {
+  _Alignas(64) _Atomic size_t head; //next slot to pop
+  _Alignas(64) _Atomic size_t tail; //next slot to push
+  _Alignas(64) shard_batch_t *slot[SHARD_QUEUE];
+} spsc_t;
+
+typedef struct shard {
+  hierarchy_t h;         //this worker's sets, at every level
+  spsc_t work;           //batches to simulate: main thread -> worker
+  spsc_t done;           //simulated batches: worker -> main thread
+  shard_batch_t *filling; //batch the main thread is filling for this worker
+  shard_batch_t *pool;   //all SHARD_QUEUE batches of this worker
+  pthread_t thread;
+} shard_t;
+
+/*
+ * spscPush, spscPop - Add a batch to a queue (false if it is full), and take
+ * the oldest one off (NULL if it is empty)
+ */
+static int spscPush(spsc_t *q, shard_batch_t *batch)
+{
+  size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+  if(tail - atomic_load_explicit(&q->head, memory_order_acquire) == SHARD_QUEUE) {
+    return 0;
+  }
+  q->slot[tail % SHARD_QUEUE] = batch;
+  atomic_store_explicit(&q->tail, tail + 1, memory_order_release); //publishes the slot
+  return 1;
+}
+
+static shard_batch_t *spscPop(spsc_t *q)
+{
+  size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+  if(atomic_load_explicit(&q->tail, memory_order_acquire) == head) {
+    return NULL;
+  }
+  shard_batch_t *batch = q->slot[head % SHARD_QUEUE];
+  atomic_store_explicit(&q->head, head + 1, memory_order_release); //frees the slot
+  return batch;
+}
+
+/*
+ * shardWorker - Simulate batches until the empty one
+ */
+static void *shardWorker(void *arg)
+{
+  shard_t *shard = arg;
+
+  for(;;) {
+    shard_batch_t *batch;
+    while((batch = spscPop(&shard->work)) == NULL) {
+      sched_yield();
+    }
+    if(batch->n == 0) {
+      return NULL;
+    }
+    replayBatch(&shard->h, batch->access, batch->n);
+    while(!spscPush(&shard->done, batch)) {
+      sched_yield();
+    }
+  }
+}
+
+/*
+ * shardSend - Queue the worker's filling batch, and start filling a free one
+ */
+static void shardSend(shard_t *shard)
+{
+  while(!spscPush(&shard->work, shard->filling)) {
+    sched_yield();
+  }
+  while((shard->filling = spscPop(&shard->done)) == NULL) {
+    sched_yield();
+  }
+  shard->filling->n = 0;
+}
+
+/*
+ * shardDeal - Add an access to the batch of the worker owning its block
+ */
+static void shardDeal(shard_t *shards, int workers, int b, const access_t *access)
+{
+  shard_t *shard = &shards[(access->addr >> b) & (workers - 1)];
+
+  shard->filling->access[shard->filling->n++] = *access;
+  if(shard->filling->n == SHARD_BATCH) {
+    shardSend(shard);
+  }
+}
+
+/*
+ * shardTrace - Replay the trace against the hierarchy using up to jobs
+ * workers (rounded down to a power of two no bigger than the number of sets in
+ * any level), adding the merged statistics into h. An access that covers
+ * several blocks (-l) is dealt out a block at a time. Returns 0, or -1 on
+ * failure.
+ */
+int shardTrace(char* trace_fn, hierarchy_t *h, int jobs)
+{
+  static access_t batch[TRACE_BATCH];
+  trace_t trace;
+  int b = h->level[0].b;
+  int min_s = h->level[0].s;
+  int bits = 0;
+  int result = 0;
+  size_t n;
+
+  for(int k = 1; k < h->levels; k++) {
+    min_s = (h->level[k].s < min_s) ? h->level[k].s : min_s;
+  }
+  while(bits < min_s && (2 << bits) <= jobs) {
+    bits++;
+  }
+  int workers = 1 << bits;
+
+  shard_t *shards = calloc(workers, sizeof(shard_t));
+  if(shards == NULL) {
+    printf("%s\n", "Error allocating cache");
+    return -1;
+  }
+
+  for(int w = 0; w < workers; w++) {
+    shard_t *shard = &shards[w];
+    shard->pool = malloc(SHARD_QUEUE * sizeof(shard_batch_t));
+    if(shard->pool == NULL || initHierarchy(&shard->h, bits) != 0) {
+      printf("%s\n", "Error allocating cache");
+      return -1;
+    }
+    shard->filling = &shard->pool[0];
+    shard->filling->n = 0;
+    for(int i = 1; i < SHARD_QUEUE; i++) { //the rest start out free
+      spscPush(&shard->done, &shard->pool[i]);
+    }
+  }
+
+  if(openTrace(&trace, trace_fn) != 0) {
+    printf("%s\n", "Error opening file");
+    return -1;
+  }
+  skipTrace(&trace, skip_records);
+
+  for(int w = 0; w < workers; w++) {
+    pthread_create(&shards[w].thread, NULL, shardWorker, &shards[w]);
+  }
+
+  while((n = readTrace(&trace, batch, TRACE_BATCH)) > 0) {
+    for(size_t i = 0; i < n; i++) {
+      mem_addr_t last = lastBlock(&batch[i], b);
+
+      if(last == batch[i].addr >> b) {
+        shardDeal(shards, workers, b, &batch[i]);
+        continue;
+      }
+
+      //one access per block, the loads of a data modify (M) before its stores
+      access_t piece = { .len = 1, .op = (batch[i].op == 'S') ? 'S' : 'L' };
+      for(int pass = (batch[i].op == 'M') ? 2 : 1; pass > 0; pass--) {
+        for(mem_addr_t block = batch[i].addr >> b; block <= last; block++) {
+          piece.addr = block << b;
+          shardDeal(shards, workers, b, &piece);
+        }
+        piece.op = 'S';
+      }
+    }
+  }
+
+  for(int w = 0; w < workers; w++) { //flush what is left, then an empty batch to stop
+    if(shards[w].filling->n > 0) {
+      shardSend(&shards[w]);
+    }
+    shardSend(&shards[w]);
+  }
+
+  for(int w = 0; w < workers; w++) {
+    pthread_join(shards[w].thread, NULL);
+    addHierarchy(h, &shards[w].h);
+    freeHierarchy(&shards[w].h);
+    free(shards[w].pool);
+  }
+  free(shards);
+
+  if(closeTrace(&trace) != 0) {
+    printf("%s\n", "Error reading file");
+    result = -1;
+  }
+  return result;
+}
+
+/*
+ * Stack distance mode (-m)
+ *
+ * LRU is a stack algorithm: an access hits in an E-way LRU set exactly when
+ * fewer than E other blocks of its set were used since its block was last
+ * used. So one pass that measures that stack distance for every access gives
+ * the hits of every associativity for the given s and b at once (Mattson et
+ * al., 1970).
+ *
+ * Each set numbers its accesses, and a Fenwick tree over those times marks the
+ * latest access to each block; the distance is one more than the number of
+ * marks after the block's previous access. A hash table finds that previous
+ * access. When a set runs out of times its live marks are renumbered from 1.
+ */
+
+typedef struct stack_set {
+  uint32_t *tree;        //Fenwick tree over times 1..cap, marking each block's latest access
+  mem_addr_t *block_at;  //block + 1 accessed at each time, or 0 if it was accessed again since
+  uint32_t cap;
+  uint32_t now;          //time of the latest access
+  uint32_t live;         //distinct blocks accessed, the number of marks
+} stack_set_t;
+
+typedef struct stack_dist {
+  int s, b, S;
+  stack_set_t *sets;
+  lookup_t last;         //time of each block's latest access in its set
+  size_t blocks;         //entries in last
+  unsigned long *hist;   //hist[d] counts accesses at stack distance d <= MAX_E; hist[0] the rest, cold misses included
+  unsigned long accesses;
+} stack_dist_t;
+
+/*
+ * treeAdd, treeCount - Add to the mark at time i, and count the marks at times <= i
+ */
+static void treeAdd(stack_set_t *set, uint32_t i, int delta)
+{
+  for(; i <= set->cap; i += i & -i) {
+    set->tree[i] += delta;
+  }
+}
+
+static uint32_t treeCount(stack_set_t *set, uint32_t i)
+{
+  uint32_t n = 0;
+
+  for(; i > 0; i -= i & -i) {
+    n += set->tree[i];
+  }
+  return n;
+}
+
+/*
+ * renumberSet - Give the live accesses of a full set the times 1..live, in
+ * order, growing the set so at least half of it is free. Returns 0, or -1 if
+ * out of memory.
+ */
+static int renumberSet(stack_dist_t *st, stack_set_t *set)
+{
+  uint32_t cap = set->cap ? set->cap : 16;
+  while(cap < 2 * (uint64_t) set->live + 2) {
+    if(cap >= (1u << 30)) {
+      return -1;
+    }
+    cap *= 2;
+  }
+
+  uint32_t *tree = calloc(cap + 1, sizeof(uint32_t));
+  mem_addr_t *block_at = calloc(cap + 1, sizeof(mem_addr_t));
+  if(tree == NULL || block_at == NULL) {
+    free(tree);
+    free(block_at);
+    return -1;
+  }
+
+  uint32_t t = 0;
+  for(uint32_t i = 1; i <= set->now; i++) {
+    if(set->block_at[i] != 0) {
+      block_at[++t] = set->block_at[i];
+      lookupFind(&st->last, set->block_at[i] - 1)->value = (int) t;
+    }
+  }
+
+  for(uint32_t i = 1; i <= cap; i++) { //build the tree in place: every time up to t is marked
+    tree[i] += (i <= t);
+    uint32_t parent = i + (i & -i);
+    if(parent <= cap) {
+      tree[parent] += tree[i];
+    }
+  }
+
+  free(set->tree);
+  free(set->block_at);
+  set->tree = tree;
+  set->block_at = block_at;
+  set->cap = cap;
+  set->now = t;
+  return 0;
+}
+
+
+/*
+ * stackAccess - Record the stack distance of an access to addr. Returns 0, or
+ * -1 if out of memory.
+ */
+static int stackAccess(stack_dist_t *st, mem_addr_t addr)
+{
+  mem_addr_t block = addr >> st->b;
+  stack_set_t *set = &st->sets[block & (st->S - 1)];
+  struct slot *last = lookupFind(&st->last, block);
+
+  st->accesses++;
+
+  if(last != NULL) {      //reuse: count the distinct blocks used since
+    uint32_t d = set->live - treeCount(set, (uint32_t) last->value) + 1;
+    st->hist[(d <= MAX_E) ? d : 0]++;
+    treeAdd(set, (uint32_t) last->value, -1);
+    set->block_at[last->value] = 0;
+  } else {                //first use of the block: a miss at every size
+    st->hist[0]++;
+    set->live++;
+    if(2 * (st->blocks + 1) > st->last.mask + 1 && lookupGrow(&st->last) != 0) {
+      return -1;
+    }
+    lookupInsert(&st->last, block, 0);
+    st->blocks++;
+  }
+
+  if(set->now == set->cap && renumberSet(st, set) != 0) {
+    return -1;
+  }
+
+  set->now++;
+  treeAdd(set, set->now, 1);
+  set->block_at[set->now] = block + 1;
+  lookupFind(&st->last, block)->value = (int) set->now;
+  return 0;
+}
+
+/*
+ * stackTrace - Measure the stack distance of every access in the trace for the
+ * given s and b, and print the hits, misses and evictions of an LRU cache with
+ * each E from 1 to max_E (or to the longest distance seen if max_E is 0).
+ * Returns 0, or -1 on failure.
+ */
+int stackTrace(char* trace_fn, int s, int b, int max_E)
+{
+  static access_t batch[TRACE_BATCH];
+  stack_dist_t st;
+  trace_t trace;
+  size_t n;
+  int result = 0;
+
+  memset(&st, 0, sizeof(st));
+  st.s = s;
+  st.b = b;
+  st.S = 1 << s;
+  st.sets = calloc(st.S, sizeof(stack_set_t));
+  st.hist = calloc(MAX_E + 1, sizeof(unsigned long));
+  if(st.sets == NULL || st.hist == NULL || lookupGrow(&st.last) != 0) {
+    printf("%s\n", "Error allocating cache");
+    return -1;
+  }
+
+  if(openTrace(&trace, trace_fn) != 0) {
+    printf("%s\n", "Error opening file");
+    return -1;
+  }
+  skipTrace(&trace, skip_records);
+
+  while(result == 0 && (n = readTrace(&trace, batch, TRACE_BATCH)) > 0) {
+    for(size_t i = 0; i < n && result == 0; i++) {
+      mem_addr_t last = lastBlock(&batch[i], b);
+      for(int pass = (batch[i].op == 'M') ? 2 : 1; pass > 0 && result == 0; pass--) {
+        for(mem_addr_t block = batch[i].addr >> b; block <= last && result == 0; block++) {
+          result = stackAccess(&st, block << b);
+        }
+      }
+    }
+  }
+
+  if(result != 0) {
+    printf("%s\n", "Error allocating cache");
+  }
+  if(closeTrace(&trace) != 0) {
+    printf("%s\n", "Error reading file");
+    result = -1;
+  }
+
+  if(max_E == 0) {
+    for(max_E = MAX_E; max_E > 1 && st.hist[max_E] == 0; max_E--);
+  }
+
+  //a set that used k distinct blocks had min(k, E) misses that filled a free line,
+  //and its other misses evicted; filling[e] counts the sets with k >= e
+  unsigned long *filling = calloc(max_E + 2, sizeof(unsigned long));
+  if(result == 0 && filling != NULL) {
+    for(int i = 0; i < st.S; i++) {
+      filling[(st.sets[i].live < (uint32_t) max_E) ? st.sets[i].live : (uint32_t) max_E]++;
+    }
+    for(int e = max_E - 1; e >= 1; e--) {
+      filling[e] += filling[e + 1];
+    }
+
+    unsigned long hits = 0, filled = 0;
+    for(int e = 1; e <= max_E; e++) {
+      hits += st.hist[e];
+      filled += filling[e];
+      unsigned long misses = st.accesses - hits;
+      printf("E:%d hits:%lu misses:%lu evictions:%lu miss_rate:%.6f\n", e, hits, misses, misses - filled,
+             st.accesses ? (double) misses / st.accesses : 0.0);
+    }
+  }
+
+  for(int i = 0; i < st.S; i++) {
+    free(st.sets[i].tree);
+    free(st.sets[i].block_at);
+  }
+  free(filling);
+  free(st.sets);
+  free(st.hist);
+  free(st.last.slots);
+  return result;
+}
+
+/*
+ * printUsage - Print usage info
+ */
+void printUsage(char* argv[])
+{
+    printf("Usage: %s [-hvpl] [-j <num>] [-r <policy>] -s <num> -E <num> -b <num> [-k <num>] -t <file>\n", argv[0]);
+    printf("       %s [-pl] -s <num> -E <num> -b <num> [-L <s>:<E>]... [-i <inclusion>] [-w wb|wt] [-a wa|nwa] -t <file>\n", argv[0]);
+    printf("       %s [-j <num>] [-r <policy>] -x <geometries> -t <file>\n", argv[0]);
+    printf("       %s -m -s <num> [-E <num>] -b <num> -t <file>\n", argv[0]);
+    printf("       %s -c <out> -t <file>\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -v         Optional verbose flag.\n");
+    printf("  -s <num>   Number of set index bits.\n");
+    printf("  -E <num>   Number of lines per set.\n");
+    printf("  -b <num>   Number of block offset bits.\n");
+    printf("  -k <num>   Skip the first <num> records of the trace.\n");
+    printf("  -t <file>  Trace file (text or binary, optionally gzip or zstd compressed).\n");
+    printf("  -c <out>   Convert the trace to binary format in <out>.\n");
+    printf("  -x <list>  Simulate every geometry in a comma-separated list of s:E:b in one pass;\n");
+    printf("             a field may be a range lo-hi (E doubles across its range).\n");
+    printf("  -p         Simulate the cache in parallel, each worker thread owning a shard of the sets.\n");
+    printf("  -j <num>   Worker threads for -x and -p (default: one per CPU).\n");
+    printf("  -m         Print LRU hits and misses for every E up to -E (or the largest that\n");
+    printf("             matters) from one pass, using stack distances.\n");
+    printf("  -l         Honor the size of each access, touching every block it covers.\n");
+    printf("  -L <s>:<E> Add a lower level with 2^s sets of E lines (the same block size); repeatable.\n");
+    printf("  -i <name>  Inclusion of the levels: nine (default), inclusive or exclusive.\n");
+    printf("  -w <name>  Write policy: wb (write-back, default) or wt (write-through).\n");
+    printf("  -a <name>  Store miss policy: wa (write-allocate, default) or nwa (no-write-allocate).\n");
+    printf("  -r <name>  Replacement policy: lru (default), plru (tree pseudo-LRU, E a power of two),\n");
+    printf("             fifo, random, srrip, brrip or opt (Belady's, a single cache without -p).\n");
+    printf("\nExamples:\n");
+    printf("  linux>  %s -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv[0]);
+    printf("  linux>  %s -v -s 8 -E 2 -b 4 -t traces/yi.trace\n", argv[0]);
+    printf("  linux>  %s -p -j 4 -s 8 -E 2 -b 4 -t traces/yi.trace\n", argv[0]);
+    printf("  linux>  %s -x 2-8:1-16:4 -t traces/yi.trace\n", argv[0]);
+    printf("  linux>  %s -m -s 4 -b 4 -t traces/yi.trace\n", argv[0]);
+    printf("  linux>  %s -l -s 6 -E 8 -b 6 -L 10:8 -L 13:16 -i inclusive -t traces/yi.trace\n", argv[0]);
+    printf("  linux>  %s -r plru -s 4 -E 8 -b 4 -t traces/yi.trace\n", argv[0]);
+    printf("  linux>  %s -c traces/yi.bin -t traces/yi.trace\n", argv[0]);
+    exit(0);
+}
+
+/*
+ *
+ * !! DO NOT MODIFY !!
+ *
+ * printSummary - Summarize the cache simulation statistics. Student cache simulators
+ *                must call this function in order to be properly autograded.
+ */
+void printSummary(int hits, int misses, int evictions)
+{
+    printf("hits:%d misses:%d evictions:%d\n", hits, misses, evictions);
+    FILE* output_fp = fopen(".csim_results", "w");
+    assert(output_fp);
+    fprintf(output_fp, "%d %d %d\n", hits, misses, evictions);
+    fclose(output_fp);
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char* argv[])
+{
+    int c;
+    int result;
+
+    while( (c=getopt(argc,argv,"s:E:b:t:c:k:x:j:L:i:w:a:r:lmpvh")) != -1){
+        switch(c){
+        case 's':
+            s = atoi(optarg);
+            break;
+        case 'E':
+            E = atoi(optarg);
+            break;
+        case 'b':
+            b = atoi(optarg);
+            break;
+        case 't':
+            trace_file = optarg;
+            break;
+        case 'c':
+            convert_file = optarg;
+            break;
+        case 'k':
+            skip_records = strtoull(optarg, NULL, 0);
+            break;
+        case 'x':
+            sweep_spec = optarg;
+            break;
+        case 'j':
+            jobs = atoi(optarg);
+            break;
+        case 'm':
+            stack_mode = 1;
+            break;
+        case 'l':
+            honor_len = 1;
+            break;
+        case 'r':
+            replacement = findPolicy(optarg);
+            if (replacement < 0) {
+                printUsage(argv);
+                exit(1);
+            }
+            break;
+        case 'L':
+            if (levels == MAX_LEVELS || sscanf(optarg, "%d:%d", &level_s[levels], &level_E[levels]) != 2
+                || level_s[levels] <= 0 || level_E[levels] <= 0 || level_E[levels] > MAX_E) {
+                printf("%s: -L takes <s>:<E>, for at most %d levels in all\n", argv[0], MAX_LEVELS);
+                exit(1);
+            }
+            levels++;
+            hierarchy_mode = 1;
+            break;
+        case 'i':
+            if (strcmp(optarg, "nine") == 0) {
+                inclusion = INCLUSION_NINE;
+            } else if (strcmp(optarg, "inclusive") == 0) {
+                inclusion = INCLUSION_INCLUSIVE;
+            } else if (strcmp(optarg, "exclusive") == 0) {
+                inclusion = INCLUSION_EXCLUSIVE;
+            } else {
+                printUsage(argv);
+                exit(1);
+            }
+            hierarchy_mode = 1;
+            break;
+        case 'w':
+            if (strcmp(optarg, "wb") != 0 && strcmp(optarg, "wt") != 0) {
+                printUsage(argv);
+                exit(1);
+            }
+            write_back = (strcmp(optarg, "wb") == 0);
+            hierarchy_mode = 1;
+            break;
+        case 'a':
+            if (strcmp(optarg, "wa") != 0 && strcmp(optarg, "nwa") != 0) {
+                printUsage(argv);
+                exit(1);
+            }
+            write_allocate = (strcmp(optarg, "wa") == 0);
+            hierarchy_mode = 1;
+            break;
+        case 'p':
+            shard_mode = 1;
+            break;
+        case 'v':
+            verbosity = 1;
+            break;
+        case 'h':
+            printUsage(argv);
+            exit(0);
+        default:
+            printUsage(argv);
+            exit(1);
+        }
+    }
+
+    if (convert_file != NULL && trace_file != NULL) {
+        return (writeBinaryTrace(trace_file, convert_file) == 0) ? 0 : 1;
+    }
+
+    if (jobs <= 0) {
+        jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = (jobs > 0) ? jobs : 1;
+    }
+
+    if (sweep_spec != NULL && trace_file != NULL) {
+        selectKernels();
+        return (sweepTrace(trace_file, sweep_spec, jobs) == 0) ? 0 : 1;
+    }
+
+    if (stack_mode && s != 0 && b != 0 && trace_file != NULL) {
+        if (replacement != 0) {
+            printf("%s: -m models LRU only\n", argv[0]);
+            exit(1);
+        }
+        if (E < 0 || E > MAX_E) {
+            printf("%s: -E must be between 1 and %d\n", argv[0], MAX_E);
+            exit(1);
+        }
+        return (stackTrace(trace_file, s, b, E) == 0) ? 0 : 1;
+    }
+
+    /* Make sure that all required command line args were specified */
+    if (s == 0 || E == 0 || b == 0 || trace_file == NULL) {
+        printf("%s: Missing required command line argument\n", argv[0]);
+        printUsage(argv);
+        exit(1);
+    }
+
+    if (E < 0 || E > MAX_E) {
+        printf("%s: -E must be between 1 and %d\n", argv[0], MAX_E);
+        exit(1);
+    }
+
+    const policy_t *policy = &policies[replacement];
+    for (int k = 0; k < levels; k++) {
+        int e = k ? level_E[k] : E;
+        if ((policy->flags & POLICY_POW2) && (e & (e - 1)) != 0) {
+            printf("%s: -r %s needs E to be a power of two\n", argv[0], policy->name);
+            exit(1);
+        }
+    }
+    if ((policy->flags & POLICY_OFFLINE) && (shard_mode || hierarchy_mode)) {
+        printf("%s: -r %s simulates a single cache, without -p\n", argv[0], policy->name);
+        exit(1);
+    }
+
+    /* Compute S, E and B from command line args */
+    S = (unsigned int) pow(2, s);
+    B = (unsigned int) pow(2, b);
+
+    /* Initialize cache */
+    selectKernels();
+    if (initHierarchy(&hierarchy, 0) != 0) {
+        printf("%s\n", "Error allocating cache");
+        exit(1);
+    }
+
+#ifdef DEBUG_ON
+    printf("DEBUG: S:%u E:%u B:%u trace:%s\n", S, E, B, trace_file);
+#endif
+
+    if (policy->flags & POLICY_OFFLINE) {
+        result = beladyTrace(trace_file, &hierarchy.level[0]);
+    } else {
+        result = shard_mode ? shardTrace(trace_file, &hierarchy, jobs) : replayTrace(trace_file);
+    }
+    if (result != 0) {
+        freeHierarchy(&hierarchy);
+        exit(1);
+    }
+
+    /* Free allocated memory */
+    freeHierarchy(&hierarchy);
+
+    /* Output the hit and miss statistics for the autograder */
+    if (hierarchy_mode) {
+        printHierarchy(&hierarchy);
+    }
+    cache_t *l1 = &hierarchy.level[0];
+    printSummary((int) l1->hits, (int) l1->misses, (int) l1->evictions);
+
+    return 0;
+}
@@ -2,7 +2,21 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            The model is split into MEM_ARENAS arenas. Arena i owns the
+ *            MAX_HEAP bytes starting at mem_start + i * MAX_HEAP and has its
+ *            own brk pointer, so the arena an address belongs to can be
+ *            computed from the address alone. The original single-heap
+ *            functions operate on arena 0, except that mem_heapsize,
+ *            mem_heap_hi and mem_reset_brk cover every arena.
+ *
+ *            Arenas can be shrunk with mem_arena_trim, which hands the
+ *            released pages back to the OS. Large allocations can also be
+ *            mapped directly with mem_map; those regions are not part of
+ *            any arena and are counted separately by mem_mapsize, and
+ *            can be shrunk in place with mem_remap.
  */
+#define _GNU_SOURCE   /* for mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,79 +24,238 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <stdatomic.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* one arena of the modeled heap */
+typedef struct {
+  char *start_brk;   /* points to first byte of the arena's heap */
+  char *_Atomic brk; /* points to last byte of the arena's heap; atomic since
+                        mem_heapsize reads every arena's without their locks */
+  char *max_addr;    /* largest legal address in the arena */
+} mem_arena_t;
+
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */
+static char *mem_start;                   /* first byte of the storage for all arenas */
+static mem_arena_t mem_arenas[MEM_ARENAS];
+static _Atomic size_t mem_mapped;         /* bytes currently mapped with mem_map */
+
+/*
+ * get_brk, set_brk - read and move an arena's brk. Relaxed is enough: the
+ *    brk only moves under the caller's lock for that arena, and readers
+ *    without that lock, such as mem_heapsize, just want a recent value.
+ */
+static char *get_brk(mem_arena_t *a) {
+  return atomic_load_explicit(&a->brk, memory_order_relaxed);
+}
+
+static void set_brk(mem_arena_t *a, char *brk) {
+  atomic_store_explicit(&a->brk, brk, memory_order_relaxed);
+}
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void) {
-  /* allocate the storage we will use to model the available VM */
-  if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-    fprintf(stderr, "mem_init_vm: malloc error\n");
+  /* reserve the storage we will use to model the available VM; pages are
+     only backed by memory once an arena's brk moves over them */
+  mem_start = mmap(NULL, (size_t)MEM_ARENAS * MAX_HEAP, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mem_start == MAP_FAILED) {
+    fprintf(stderr, "mem_init_vm: mmap error\n");
     exit(1);
   }
 
-  mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-  mem_brk = mem_start_brk;                  /* heap is empty initially */
+  for (int i = 0; i < MEM_ARENAS; i++) {
+    mem_arenas[i].start_brk = mem_start + (size_t)i * MAX_HEAP;
+    mem_arenas[i].max_addr = mem_arenas[i].start_brk + MAX_HEAP;  /* max legal arena address */
+    set_brk(&mem_arenas[i], mem_arenas[i].start_brk);             /* arena is empty initially */
+  }
 }
 
 /* 
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void) {
-  free(mem_start_brk);
+  munmap(mem_start, (size_t)MEM_ARENAS * MAX_HEAP);
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointers to make every arena empty
  */
 void mem_reset_brk() {
-  mem_brk = mem_start_brk;
+  for (int i = 0; i < MEM_ARENAS; i++) {
+    mem_arena_reset_brk(i);
+  }
+}
+
+/*
+ * mem_arena_reset_brk - reset the simulated brk pointer of one arena
+ */
+void mem_arena_reset_brk(int arena) {
+  set_brk(&mem_arenas[arena], mem_arenas[arena].start_brk);
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. The
+ *    heap only shrinks through mem_arena_trim.
  */
 void *mem_sbrk(size_t incr) {
-  char *old_brk = mem_brk;
+  return mem_arena_sbrk(0, incr);
+}
+
+/* 
+ * mem_arena_sbrk - mem_sbrk for one arena. Different arenas may be
+ *    extended concurrently.
+ */
+void *mem_arena_sbrk(int arena, size_t incr) {
+  mem_arena_t *a = &mem_arenas[arena];
+  char *old_brk = get_brk(a);
 
-  if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr) ) {
+  if ((size_t)(a->max_addr - old_brk) < incr) {
     errno = ENOMEM;
     fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
     return (void *)-1;
   }
-  mem_brk += incr;
+  set_brk(a, old_brk + incr);
   return (void *)old_brk;
 }
 
+/*
+ * mem_arena_trim - the shrinking counterpart of mem_arena_sbrk. Moves the
+ *    arena's brk down by decr bytes and tells the OS it may reclaim every
+ *    whole page above the new brk. Returns 0 on success, -1 if the arena
+ *    is smaller than decr.
+ */
+int mem_arena_trim(int arena, size_t decr) {
+  mem_arena_t *a = &mem_arenas[arena];
+  size_t pagesize = mem_pagesize();
+  char *brk = get_brk(a);
+
+  if ((size_t)(brk - a->start_brk) < decr) {
+    errno = EINVAL;
+    return -1;
+  }
+  brk -= decr;
+  set_brk(a, brk);
+
+  /* release the pages lying entirely above the new brk */
+  char *first_page = mem_start + ((size_t)(brk - mem_start) + pagesize - 1) / pagesize * pagesize;
+  char *end = brk + decr;
+  if (first_page < end) {
+    madvise(first_page, (size_t)(end - first_page), MADV_DONTNEED);
+  }
+  return 0;
+}
+
+/*
+ * mem_map - map a fresh page-aligned region of size bytes straight from
+ *    the OS. Returns NULL if the mapping fails.
+ */
+void *mem_map(size_t size) {
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (p == MAP_FAILED) {
+    return NULL;
+  }
+  mem_mapped += size;
+  return p;
+}
+
+/*
+ * mem_unmap - give a region from mem_map back to the OS
+ */
+void mem_unmap(void *p, size_t size) {
+  munmap(p, size);
+  mem_mapped -= size;
+}
+
+/*
+ * mem_remap - shrink a region from mem_map of old_size bytes to new_size
+ *    bytes, both page multiples, without moving it. The pages past the
+ *    new end go back to the OS. Returns 0 on success, -1 on failure.
+ */
+int mem_remap(void *p, size_t old_size, size_t new_size) {
+  if (new_size > old_size || mremap(p, old_size, new_size, 0) == MAP_FAILED) {
+    return -1;
+  }
+  mem_mapped -= old_size - new_size;
+  return 0;
+}
+
+/*
+ * mem_mapsize - returns the number of bytes currently mapped with mem_map
+ */
+size_t mem_mapsize() {
+  return mem_mapped;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
 void *mem_heap_lo() {
-  return (void *)mem_start_brk;
+  return mem_arena_lo(0);
 }
 
 /* 
- * mem_heap_hi - return address of last heap byte
+ * mem_heap_hi - return address of last heap byte in any arena
  */
 void *mem_heap_hi() {
-  return (void *)(mem_brk - 1);
+  int i = MEM_ARENAS - 1;
+
+  while (i > 0 && get_brk(&mem_arenas[i]) == mem_arenas[i].start_brk) {  /* highest arena in use */
+    i--;
+  }
+  return mem_arena_hi(i);
+}
+
+/*
+ * mem_arena_lo - return address of the first heap byte of an arena
+ */
+void *mem_arena_lo(int arena) {
+  return (void *)mem_arenas[arena].start_brk;
 }
 
 /*
- * mem_heapsize() - returns the heap size in bytes
+ * mem_arena_hi - return address of the last heap byte of an arena
+ */
+void *mem_arena_hi(int arena) {
+  return (void *)(get_brk(&mem_arenas[arena]) - 1);
+}
+
+/*
+ * mem_heapsize() - returns the heap size in bytes, summed over all arenas
  */
 size_t mem_heapsize() {
-  return (size_t)(mem_brk - mem_start_brk);
+  size_t size = 0;
+
+  for (int i = 0; i < MEM_ARENAS; i++) {
+    size += mem_arena_heapsize(i);
+  }
+  return size;
+}
+
+/*
+ * mem_arena_heapsize() - returns the heap size of one arena in bytes
+ */
+size_t mem_arena_heapsize(int arena) {
+  return (size_t)(get_brk(&mem_arenas[arena]) - mem_arenas[arena].start_brk);
+}
+
+/*
+ * mem_arena_of - returns the arena that address p lies in, or -1
+ *    if p is not in the modeled heap
+ */
+int mem_arena_of(const void *p) {
+  const char *cp = (const char *)p;
+
+  if (cp < mem_start || cp >= mem_start + (size_t)MEM_ARENAS * MAX_HEAP) {
+    return -1;
+  }
+  return (int)((size_t)(cp - mem_start) / MAX_HEAP);
 }
 
 /*
@@ -0,0 +1,34 @@
+/*
+ * memlib.h - interface to the memory system model in memlib.c
+ */
+#include <unistd.h>
+
+/*
+ * Number of independent arenas the model provides. Each arena is its own
+ * contiguous region of MAX_HEAP bytes with its own brk pointer.
+ */
+#define MEM_ARENAS 8
+
+void mem_init(void);
+void mem_deinit(void);
+void *mem_sbrk(size_t incr);
+void mem_reset_brk(void);
+void *mem_heap_lo(void);
+void *mem_heap_hi(void);
+size_t mem_heapsize(void);
+size_t mem_pagesize(void);
+
+/* Per-arena counterparts of the functions above */
+void *mem_arena_sbrk(int arena, size_t incr);
+void mem_arena_reset_brk(int arena);
+void *mem_arena_lo(int arena);
+void *mem_arena_hi(int arena);
+size_t mem_arena_heapsize(int arena);
+int mem_arena_of(const void *p);
+int mem_arena_trim(int arena, size_t decr);
+
+/* Regions mapped directly from the OS, outside every arena */
+void *mem_map(size_t size);
+void mem_unmap(void *p, size_t size);
+int mem_remap(void *p, size_t old_size, size_t new_size);
+size_t mem_mapsize(void);
@@ -1,7 +1,7 @@
 /*
  ***********************************************************************************
  *                                   mm.c                                          *
- *  Starter package for a 64-bit struct-based explicit free list memory allocator  *
+ *  64-bit struct-based segregated explicit free list memory allocator             *
  *                                                                                 *
  *  ********************************************************************************
  */
@@ -11,21 +11,27 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "memlib.h"
 #include "mm.h"
 
  /*
  *
- * Each block has header and footer of the form:
+ * Each block has a header (and free blocks a footer) of the form:
  *
- *      63                  4  3  2  1  0
- *      -----------------------------------
- *     | s  s  s  s  ... s  s  0  0  0  a/f
- *      -----------------------------------
+ *      63                  4  3  2   1    0
+ *      ---------------------------------------
+ *     | s  s  s  s  ... s  s  0  m  pa/f  a/f
+ *      ---------------------------------------
  *
- * where s are the meaningful size bits and a/f is set
- * iff the block is allocated. The list has the following form:
+ * where s are the meaningful size bits, a/f is set iff the block is
+ * allocated and pa/f is set iff the previous block in the heap is
+ * allocated. pa/f is only meaningful in headers. m is set iff the block
+ * was mapped on its own rather than carved out of a heap (see below).
+ * The list has the following form:
  *
  *
  *    begin                                   end
@@ -42,9 +48,69 @@
  *
  */
 
+/*
+ * Free blocks are kept on one of MM_NUM_CLASSES explicit free lists, segregated by
+ * block size. Class 0 holds blocks of exactly min_block_size bytes and every
+ * following class holds blocks up to twice the limit of the class before it:
+ *
+ *   class:     0     1         2           3             MM_NUM_CLASSES-1
+ *   sizes:    32  (32,64]  (64,128]  (128,256]  ...   (> previous limit)
+ *
+ * Each list is kept in LIFO order. A fit is searched for by starting at the
+ * smallest class that could hold the request and moving to larger classes.
+ * How the starting class is searched depends on the fit policy chosen at
+ * mm_init_config time: first fit, next fit (each class has a roving pointer
+ * where the previous search stopped) or bounded best fit (the smallest of the
+ * first best_fit_n blocks that fit). Blocks in larger classes always fit, so
+ * the head of the first non-empty one is taken.
+ *
+ * Heaps grow by at least the arena's current chunk size. With adaptive_chunks
+ * set, the chunk doubles after every extension (up to max_chunksize) while at
+ * least half of the heap is in use, and halves (down to chunksize) otherwise.
+ */
+
+/*
+ * Large blocks (asize >= mmap_threshold) don't live in any heap. Each one gets
+ * its own region from mem_map, laid out as
+ *
+ *   | pad word | HEADER: region size | m | pa | a | Data ...              |
+ *   ^ region start (page aligned)                  ^ payload (16-byte aligned)
+ *
+ * and freeing the block unmaps the region. mm_realloc shrinks such a block
+ * in place while it stays large, handing the pages past its new end back
+ * with mem_remap. In the other direction, when a
+ * free at the end of a heap leaves a free block bigger than trim_threshold,
+ * all but one chunk of it is given back with mem_arena_trim.
+ */
+
+/*
+ * The heap is split into MEM_ARENAS arenas, one per memlib arena. Each arena
+ * is an independent heap with its own prologue, epilogue, free lists and
+ * lock. Threads are assigned an arena round-robin the first time they
+ * allocate, and a block is always freed back to the arena its address lies
+ * in, whichever thread frees it. Arenas other than arena 0 are only set up
+ * when a thread is first assigned to them.
+ *
+ * In front of the arenas, each thread keeps a small cache (tcache) of
+ * recently freed small blocks, one singly linked bin per block size, that
+ * mm_malloc and mm_free use without taking the lock:
+ *
+ *   bin:        0    1    2   ...   TCACHE_BINS-1
+ *   size:      32   48   64   ...   32 + 16 * (TCACHE_BINS-1)
+ *
+ * Cached blocks stay marked allocated in the heap, so nothing else sees
+ * them. Each bin is a small array in the cache itself, holding at most
+ * TCACHE_COUNT blocks, after which frees go to the shared heap. Every arena
+ * has a generation that mm_init and mm_arena_reset advance when they throw
+ * its heap away. The next time a thread uses its cache after that, it
+ * drops the blocks it cached from those arenas, without reading their
+ * memory, and frees the rest back to their arenas. When a thread exits, a
+ * pthread key destructor frees what is left in its cache the same way.
+ */
+
 /*  Empty block
  *  ------------------------------------------------*
- *  |HEADER:    block size   |     |     | alloc bit|
+ *  |HEADER:    block size   |     |prev a| alloc bit|
  *  |-----------------------------------------------|
  *  | pointer to prev free block in this size list  |
  *  |-----------------------------------------------|
@@ -56,7 +122,7 @@
 
 /*   Allocated block
  *   ------------------------------------------------*
- *   |HEADER:    block size   |     |     | alloc bit|
+ *   |HEADER:    block size   |     |prev a| alloc bit|
  *   |-----------------------------------------------|
  *   |               Data                            |
  *   |-----------------------------------------------|
@@ -64,6 +130,10 @@
  *   |-----------------------------------------------|
  *   |FOOTER:    block size   |     |     | alloc bit|
  *   -------------------------------------------------
+ *
+ * When elide_footers is set, allocated blocks have no footer and the data
+ * runs to the end of the block. The previous block's alloc bit in the next
+ * header is what lets coalesce_block avoid reading a footer that isn't there.
  */
 
 /* Basic constants */
@@ -79,6 +149,7 @@ static const size_t dsize = 2 * sizeof(word_t);
 /*
   Minimum useable block size (bytes):
   two words for header & footer, two words for payload
+  (a free block still needs both links and its footer)
 */
 static const size_t min_block_size = 4 * sizeof(word_t);
 
@@ -86,9 +157,39 @@ static const size_t min_block_size = 4 * sizeof(word_t);
 */
 static const size_t chunksize = (1 << 12);
 
+// Blocks of at least this size (bytes) are mapped on their own instead of coming from a heap
+static const size_t mmap_threshold = (1 << 17);
+
+// Free space at the end of a heap beyond this size (bytes) is given back to memlib
+static const size_t trim_threshold = (1 << 17);
+
+// Largest heap extension (bytes) adaptive chunk growth will make
+static const size_t max_chunksize = (1 << 17);
+
+// Number of per-thread cache bins, one per block size starting at min_block_size
+#define TCACHE_BINS 32
+
+// Maximum number of blocks held in each per-thread cache bin
+#define TCACHE_COUNT 7
+
+// Blocks mm_free_batch gathers before taking an arena's lock to free them
+#define FREE_BATCH_MAX 64
+
+/*
+  If true, allocated blocks do not carry a footer, saving a word of overhead
+  per allocation. Free blocks always keep their footer.
+*/
+static const bool elide_footers = true;
+
 // Mask to extract allocated bit from header
 static const word_t alloc_mask = 0x1;
 
+// Mask to extract the previous block's allocated bit from header
+static const word_t prev_alloc_mask = 0x2;
+
+// Mask to extract the mapped bit from header
+static const word_t mapped_mask = 0x4;
+
 /*
  * Assume: All block sizes are a multiple of 16
  * and so can use lower 4 bits for flags
@@ -96,10 +197,11 @@ static const word_t alloc_mask = 0x1;
 static const word_t size_mask = ~(word_t) 0xF;
 
 /*
-  All blocks have both headers and footers
+  All blocks have headers; free blocks (and allocated blocks, unless
+  elide_footers is set) also have footers
 
   Both the header and the footer consist of a single word containing the
-  size and the allocation flag, where size is the total size of the block,
+  size and the allocation flags, where size is the total size of the block,
   including header, (possibly payload), unused space, and footer
 */
 
@@ -111,8 +213,15 @@ struct block
     /* Header contains:
     *  a. size
     *  b. allocation flag
+    *  c. allocation flag of the previous block
+    *  d. whether the block was mapped on its own
+    *
+    * Atomic because mm_free and mm_realloc read the header of an allocated
+    * block before taking a lock, while the thread freeing or allocating its
+    * neighbour may be rewriting its prev alloc bit under the arena's lock.
+    * Always accessed relaxed, through load_header and store_header.
     */
-    word_t header;
+    _Atomic word_t header;
 
     union
     {
@@ -141,32 +250,99 @@ struct block
      */
 };
 
+/* One independent heap */
+typedef struct arena
+{
+    pthread_mutex_t lock;               // protects the heap and free lists of this arena
+    int id;                             // memlib arena the heap lives in
+    block_t *heap_start;                // pointer to first block, NULL until the arena is set up
+    block_t *seg_list[MM_NUM_CLASSES];     // pointers to the first block in each size class free list
+    block_t *rover[MM_NUM_CLASSES];        // where the last next fit search of each class stopped
+    size_t chunk;                       // current heap extension size
+    size_t in_use;                      // bytes in allocated blocks (including cached ones)
+
+    /* Statistics reported by mm_stats */
+    size_t free_count[MM_NUM_CLASSES];  // number of blocks on each free list
+    unsigned long splits;               // blocks split in two by split_block
+    unsigned long coalesces;            // free blocks merged with a free neighbour
+    unsigned long extends;              // successful extend_heap calls
+    unsigned long trims;                // times trim_heap shrank the heap
+    unsigned long probes[MM_PROBE_BUCKETS]; // find_fit searches by number of blocks examined
+} arena_t;
+
 /* Global variables */
 
-// Pointer to first block
-static block_t *heap_start = NULL;
+// Options given to mm_init_config
+static mm_config_t config;
+
+// All arenas, indexed by memlib arena
+static arena_t arenas[MEM_ARENAS];
+
+// Arena the next new thread is assigned to (modulo MEM_ARENAS)
+static _Atomic unsigned next_arena = 0;
+
+// Arena this thread allocates from, NULL until its first allocation
+static _Thread_local arena_t *thread_arena = NULL;
+
+// Incremented by mm_init and mm_arena_reset after advancing arena_generation, so thread caches can tell cheaply that some arena was reset
+static _Atomic unsigned long heap_generation = 0;
+
+// Incremented each time an arena's heap is thrown away; blocks cached from an earlier generation no longer exist
+static _Atomic unsigned long arena_generation[MEM_ARENAS];
+
+// Largest mem_heapsize() seen since mm_init
+static _Atomic size_t peak_heap = 0;
+
+/* Per-thread cache of freed small blocks */
+typedef struct tcache
+{
+    unsigned long generation;                     // heap_generation when the cache was last brought up to date
+    unsigned long arena_generation[MEM_ARENAS];   // each arena's generation then
+    block_t *bins[TCACHE_BINS][TCACHE_COUNT];     // cached blocks of each size, used as stacks
+    size_t counts[TCACHE_BINS];                   // number of blocks in each bin
+    bool registered;                              // whether tcache_key will flush this cache when the thread exits
+} tcache_t;
+
+static _Thread_local tcache_t tcache;
 
-// Pointer to the first block in the free list
-static block_t *free_list_head = NULL;
+// Key whose destructor flushes an exiting thread's cache, created once by tcache_register
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
 
 /* Function prototypes for internal helper routines */
 
 static size_t max(size_t x, size_t y);
-static block_t *find_fit(size_t asize);
-static block_t *coalesce_block(block_t *block);
-static void split_block(block_t *block, size_t asize);
+static size_t min(size_t x, size_t y);
+static size_t adjust_size(size_t size);
+static size_t find_class(size_t size);
+static block_t *find_fit(arena_t *arena, size_t asize);
+static block_t *first_fit(arena_t *arena, size_t class, size_t asize, size_t *probes);
+static block_t *next_fit(arena_t *arena, size_t class, size_t asize, size_t *probes);
+static block_t *best_fit(arena_t *arena, size_t class, size_t asize, size_t *probes);
+static void record_probes(arena_t *arena, size_t probes);
+static block_t *coalesce_block(arena_t *arena, block_t *block);
+static void split_block(arena_t *arena, block_t *block, size_t asize);
+static void carve_blocks(arena_t *arena, block_t *block, size_t asize, size_t n, void **out);
+static void free_blocks(arena_t *arena, block_t **blocks, size_t n);
 
 static size_t round_up(size_t size, size_t n);
-static word_t pack(size_t size, bool alloc);
+static word_t pack(size_t size, bool alloc, bool prev_alloc);
+
+static word_t load_header(block_t *block);
+static void store_header(block_t *block, word_t word);
 
 static size_t extract_size(word_t header);
 static size_t get_size(block_t *block);
 
 static bool extract_alloc(word_t header);
 static bool get_alloc(block_t *block);
+static bool get_prev_alloc(block_t *block);
+static bool get_mapped(block_t *block);
+static size_t payload_size(block_t *block);
 
-static void write_header(block_t *block, size_t size, bool alloc);
+static void write_header(block_t *block, size_t size, bool alloc, bool prev_alloc);
 static void write_footer(block_t *block, size_t size, bool alloc);
+static void write_prev_alloc(block_t *block, bool prev_alloc);
 
 static block_t *payload_to_header(void *bp);
 static void *header_to_payload(block_t *block);
@@ -176,143 +352,774 @@ static block_t *find_next(block_t *block);
 static word_t *find_prev_footer(block_t *block);
 static block_t *find_prev(block_t *block);
 
-static bool check_heap();
-static void examine_heap();
+static bool check_heap(arena_t *arena);
+static void examine_heap(arena_t *arena);
+
+static arena_t *get_thread_arena(void);
+static arena_t *block_arena(block_t *block);
+static int init_heap(arena_t *arena);
+static block_t *extend_heap(arena_t *arena, size_t size);
+static block_t *grow_heap(arena_t *arena, size_t size);
+static void update_peak_heap(void);
+static void insert_block(arena_t *arena, block_t *free_block);
+static void remove_block(arena_t *arena, block_t *free_block);
+static bool resize_block(arena_t *arena, block_t *block, size_t asize);
+static void trim_heap(arena_t *arena, block_t *block);
+
+static block_t *map_block(size_t asize);
+static void unmap_block(block_t *block);
+static void shrink_mapped_block(block_t *block, size_t asize);
+
+static block_t *tcache_get(size_t asize);
+static bool tcache_put(block_t *block, size_t size);
+static void tcache_register(void);
+static void tcache_flush(void);
+
+/*
+ * mm_init - Initialize the memory manager with the default options
+ */
+int mm_init(void)
+{
+    return mm_init_config(NULL);
+}
+
+/*
+ * mm_init_config - Initialize the memory manager with the given options,
+ *                  or the defaults (first fit, fixed chunks) if config is NULL
+ */
+int mm_init_config(const mm_config_t *options)
+{
+    if (options == NULL) {
+        config.fit_policy = MM_FIRST_FIT;
+        config.best_fit_n = 8;
+        config.adaptive_chunks = 0;
+    } else {
+        config = *options;
+    }
+
+    if (config.fit_policy == MM_BEST_FIT && config.best_fit_n == 0) {
+        printf("ERROR: best_fit_n must be at least 1 in mm_init_config\n");
+        return -1;
+    }
+
+    for (int i = 0; i < MEM_ARENAS; i++) {
+        memset(&arenas[i], 0, sizeof(arena_t)); //also clears the statistics
+        pthread_mutex_init(&arenas[i].lock, NULL);
+        arenas[i].id = i;
+        arenas[i].heap_start = NULL; //set up on first use
+    }
+
+    for (int i = 0; i < MEM_ARENAS; i++) {
+        arena_generation[i]++; //blocks cached by any thread belonged to the old heaps
+    }
+    heap_generation++;
+    peak_heap = 0;
+
+    pthread_mutex_lock(&arenas[0].lock);
+    int result = init_heap(&arenas[0]);
+    pthread_mutex_unlock(&arenas[0].lock);
+
+    return result;
+}
+
+/*
+ * mm_arena_reset - Throw away every block in one arena and start it over
+ *                  from an empty memlib arena. No thread may still be using
+ *                  blocks from that arena. Its blocks sitting in thread caches
+ *                  are dropped the next time their thread uses its cache.
+ */
+void mm_arena_reset(int id)
+{
+    arena_t *arena = &arenas[id];
+
+    pthread_mutex_lock(&arena->lock);
+
+    arena_generation[id]++; //thread caches may hold blocks from this arena
+    heap_generation++;
+    mem_arena_reset_brk(id);
+    arena->heap_start = NULL; //set up again on next use
+
+    pthread_mutex_unlock(&arena->lock);
+}
+
+/*
+ * init_heap - Create an empty heap with one free chunk in an arena. Called with the arena's lock held.
+ */
+static int init_heap(arena_t *arena)
+{
+    /* Start with every size class empty */
+    for (size_t i = 0; i < MM_NUM_CLASSES; i++) {
+        arena->seg_list[i] = NULL;
+        arena->rover[i] = NULL;
+        arena->free_count[i] = 0;
+    }
+    arena->chunk = chunksize;
+    arena->in_use = 0;
+
+    /* Create the initial empty heap */
+    word_t *start = (word_t *)(mem_arena_sbrk(arena->id, 2*wsize));
+    if ((ssize_t)start == -1) {
+        printf("ERROR: mem_sbrk failed in mm_init, returning %p\n", start);
+        return -1;
+    }
+
+    /* Prologue footer */
+    start[0] = pack(0, true, true);
+    /* Epilogue header, preceded by the allocated prologue */
+    start[1] = pack(0, true, true);
+
+    /* Heap starts with first "block header", currently the epilogue header */
+    arena->heap_start = (block_t *) &(start[1]);
+
+    /* Extend the empty heap with a free block of chunksize bytes,
+       extend_heap places it on the free list of its size class */
+    block_t *free_block = extend_heap(arena, chunksize);
+    if (free_block == NULL) {
+        printf("ERROR: extend_heap failed in mm_init, returning");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * mm_stats - Fill in stats with the allocator's current statistics, summed
+ *            over all arenas
+ */
+void mm_stats(mm_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    for (int i = 0; i < MEM_ARENAS; i++) {
+        arena_t *arena = &arenas[i];
+
+        pthread_mutex_lock(&arena->lock);
+
+        stats->bytes_in_use += arena->in_use;
+        for (size_t j = 0; j < MM_NUM_CLASSES; j++) {
+            stats->free_blocks[j] += arena->free_count[j];
+        }
+        stats->splits += arena->splits;
+        stats->coalesces += arena->coalesces;
+        stats->extend_heap_calls += arena->extends;
+        stats->trims += arena->trims;
+        for (size_t j = 0; j < MM_PROBE_BUCKETS; j++) {
+            stats->probe_hist[j] += arena->probes[j];
+        }
+
+        pthread_mutex_unlock(&arena->lock);
+    }
+
+    stats->mapped_bytes = mem_mapsize();
+    stats->bytes_in_use += stats->mapped_bytes;
+    stats->heap_size = mem_heapsize();
+    stats->peak_heap_size = peak_heap;
+}
+
+/*
+ * mm_malloc - Allocate a block with at least size bytes of payload
+ */
+void *mm_malloc(size_t size)
+{
+    size_t asize;      // Allocated block size
+    block_t *block;
+    arena_t *arena;
+
+    if (size == 0) // Ignore spurious request
+        return NULL;
+
+    asize = adjust_size(size);
+
+    if (asize == 0) { //no block could be that big
+      return NULL;
+    }
+
+    if (asize >= mmap_threshold) { //large blocks get a mapping of their own
+      block = map_block(asize);
+      return (block == NULL) ? NULL : header_to_payload(block);
+    }
+
+    block = tcache_get(asize); //a recently freed block of this size, without locking
+    if(block != NULL) {
+      return header_to_payload(block);
+    }
+
+    arena = get_thread_arena();
+    pthread_mutex_lock(&arena->lock);
+
+    if (arena->heap_start == NULL && init_heap(arena) != 0) { //first use of this arena
+      pthread_mutex_unlock(&arena->lock);
+      return NULL;
+    }
+
+    block = find_fit(arena, asize);   //find's first possible fit in the heap for block to be allocated
+
+    if(block == NULL) {                   //if there was no fit for the block
+      grow_heap(arena, asize);            //extend the heap and search for the first possible fit for the block
+      block = find_fit(arena, asize);
+      if(block == NULL) {                 //the heap could not be extended
+        pthread_mutex_unlock(&arena->lock);
+        return NULL;
+      }
+    }
+
+    size_t newSize = get_size(block);
+
+    remove_block(arena, block); //remove the newly allocated block from the free list
+
+    write_header(block, newSize, 1, get_prev_alloc(block));  //write new header (and footer) for allocated block
+    if(!elide_footers) {
+      write_footer(block, newSize, 1);
+    }
+    write_prev_alloc(find_next(block), 1); //the next block now follows an allocated block
+
+    split_block(arena, block, asize); //split the block (if possible)
+    arena->in_use += get_size(block);
 
-static block_t *extend_heap(size_t size);
-static void insert_block(block_t *free_block);
-static void remove_block(block_t *free_block);
+    pthread_mutex_unlock(&arena->lock);
+
+    return header_to_payload(block);
+}
+
+/*
+ * mm_malloc_batch - Allocate n blocks with at least size bytes of payload each,
+ *                   storing their payloads in out. After the thread cache is used
+ *                   up, the blocks are carved back to back out of as few free blocks
+ *                   as possible under a single lock. Returns the number of blocks
+ *                   allocated, which is less than n only if memory ran out.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out)
+{
+    size_t asize;      // Allocated block size
+    size_t done = 0;   // Blocks allocated so far
+    block_t *block;
+    arena_t *arena;
+
+    if (size == 0 || n == 0)
+        return 0;
+
+    asize = adjust_size(size);
+
+    if (asize == 0) { //no block could be that big
+      return 0;
+    }
+
+    if (asize >= mmap_threshold) { //each large block is its own mapping anyway
+      while (done < n && (out[done] = mm_malloc(size)) != NULL) {
+        done++;
+      }
+      return done;
+    }
+
+    while (done < n && (block = tcache_get(asize)) != NULL) {
+      out[done++] = header_to_payload(block);
+    }
+
+    if (done == n) {
+      return done;
+    }
+
+    arena = get_thread_arena();
+    pthread_mutex_lock(&arena->lock);
+
+    if (arena->heap_start == NULL && init_heap(arena) != 0) { //first use of this arena
+      pthread_mutex_unlock(&arena->lock);
+      return done;
+    }
+
+    size_t run_max = max(trim_threshold / asize, 1); //blocks carved from one fit, so a big batch needs no huge free block
+
+    while (done < n) {
+      size_t run = min(n - done, run_max);
+
+      block = find_fit(arena, run * asize);
+      if (block == NULL) {
+        grow_heap(arena, run * asize);
+        block = find_fit(arena, run * asize);
+      }
+
+      if (block == NULL) {           //the heap could not be extended that far
+        if (run == 1) {
+          break;
+        }
+        run_max = run / 2;           //try again with shorter runs
+        continue;
+      }
+
+      carve_blocks(arena, block, asize, run, out + done);
+      done += run;
+    }
+
+    pthread_mutex_unlock(&arena->lock);
+
+    return done;
+}
+
+
+/*
+ * mm_free - Free a block
+ */
+void mm_free(void *bp)
+{
+    if (bp == NULL)
+        return;
+
+    block_t *block = payload_to_header(bp); //gets pointer to block from the payload
+
+    if (get_mapped(block)) {               //large blocks go straight back to the OS
+      unmap_block(block);
+      return;
+    }
+
+    if (tcache_put(block, get_size(block))) { //keep small blocks in this thread's cache if there is room
+      return;
+    }
+
+    arena_t *arena = block_arena(block);   //free to the arena that owns the block
+    pthread_mutex_lock(&arena->lock);
+
+    size_t size = get_size(block);
+    arena->in_use -= size;
+
+    write_header(block, size, 0, get_prev_alloc(block)); //write new header and footer for the block (0, as it is now free)
+    write_footer(block, size, 0);
+
+    block = coalesce_block(arena, block);  //coalesce, if possible, with adjacent blocks
+    trim_heap(arena, block);               //and shrink the heap if that left a lot of free space at its end
+
+    pthread_mutex_unlock(&arena->lock);
+}
+
+/*
+ * mm_free_sized - Free a block that was allocated, or last reallocated, with size
+ *                 bytes. Small blocks are never mapped and never smaller than
+ *                 adjust_size(size), so they go to the thread cache without
+ *                 reading their header; anything else is an ordinary mm_free.
+ */
+void mm_free_sized(void *bp, size_t size)
+{
+    if (bp == NULL)
+        return;
+
+    size_t asize = adjust_size(size);
+
+    if (asize == 0 || asize >= mmap_threshold || !tcache_put(payload_to_header(bp), asize)) {
+      mm_free(bp);
+    }
+}
+
+/*
+ * mm_free_batch - Free the n blocks in ptrs, skipping NULL entries. Heap blocks
+ *                 are gathered and handed to their arena up to FREE_BATCH_MAX at
+ *                 a time, and freed under one lock.
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+    block_t *pending[FREE_BATCH_MAX];
+    size_t count = 0;
+    arena_t *arena = NULL;
+
+    for (size_t i = 0; i < n; i++) {
+      if (ptrs[i] == NULL) {
+        continue;
+      }
+
+      block_t *block = payload_to_header(ptrs[i]);
+
+      if (get_mapped(block)) {
+        unmap_block(block);
+        continue;
+      }
+
+      if (tcache_put(block, get_size(block))) {
+        continue;
+      }
+
+      if (count == FREE_BATCH_MAX || (count > 0 && block_arena(block) != arena)) {
+        free_blocks(arena, pending, count);
+        count = 0;
+      }
+
+      arena = block_arena(block);
+      pending[count++] = block;
+    }
+
+    if (count > 0) {
+      free_blocks(arena, pending, count);
+    }
+}
+
+/*
+ * mm_realloc - Resize the block at ptr to hold at least size bytes of payload.
+ *              Shrinks and grows in place where possible, and only moves the
+ *              data when the block can't be grown into its neighbour.
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL) { //realloc(NULL, size) is malloc(size)
+      return mm_malloc(size);
+    }
+
+    if (size == 0) {   //realloc(ptr, 0) is free(ptr)
+      mm_free(ptr);
+      return NULL;
+    }
+
+    block_t *block = payload_to_header(ptr);
+    size_t asize = adjust_size(size);
+    size_t old_payload;
+    bool resized;
+
+    if (asize == 0) {  //no block could be that big: ptr is left as it was
+      return NULL;
+    }
+
+    if (get_mapped(block)) { //a mapped block stays put while the request is still large and fits
+      old_payload = payload_size(block);
+      resized = asize >= mmap_threshold && asize + wsize <= get_size(block);
+      if (resized) {
+        shrink_mapped_block(block, asize);
+      }
+    } else {
+      arena_t *arena = block_arena(block);
+
+      pthread_mutex_lock(&arena->lock);
+      old_payload = payload_size(block);
+      resized = resize_block(arena, block, asize);
+      pthread_mutex_unlock(&arena->lock);
+    }
+
+    if (resized) {
+      return ptr;
+    }
+
+    //can't resize in place: move to a new block
+    void *newptr = mm_malloc(size);
+    if (newptr == NULL) {
+      return NULL;
+    }
+
+    memcpy(newptr, ptr, (old_payload < size) ? old_payload : size);
+    mm_free(ptr);
+
+    return newptr;
+}
+
+/*
+ * resize_block - Try to resize an allocated block to asize bytes without moving it.
+ *                Returns false if the block would have to move. Called with the arena's lock held.
+ */
+static bool resize_block(arena_t *arena, block_t *block, size_t asize)
+{
+    size_t block_size = get_size(block);
+
+    if (asize <= block_size) {   //shrinking (or same size): give the tail back to the free lists
+      split_block(arena, block, asize);
+      arena->in_use -= block_size - get_size(block);
+      return true;
+    }
+
+    block_t *next_block = find_next(block);
+
+    //if this is the last block in the heap (possibly followed by one free block),
+    //grow the heap so the free space after it is big enough, unless the block
+    //is now large enough that it should be mapped on its own
+    if (asize < mmap_threshold &&
+        (get_size(next_block) == 0 || (!get_alloc(next_block) && get_size(find_next(next_block)) == 0))) {
+      size_t avail = block_size + (get_alloc(next_block) ? 0 : get_size(next_block));
+      if (avail < asize && grow_heap(arena, asize - avail) == NULL) {
+        return false;
+      }
+      next_block = find_next(block); //extend_heap coalesced the new space with any free block after us
+    }
+
+    if (!get_alloc(next_block) && block_size + get_size(next_block) >= asize) { //absorb the free next block
+      size_t newSize = block_size + get_size(next_block);
+
+      remove_block(arena, next_block);
+
+      write_header(block, newSize, 1, get_prev_alloc(block));
+      if(!elide_footers) {
+        write_footer(block, newSize, 1);
+      }
+      write_prev_alloc(find_next(block), 1);
+
+      split_block(arena, block, asize); //give back whatever we didn't need
+      arena->in_use += get_size(block) - block_size;
+      return true;
+    }
+
+    return false;
+}
+
+/*
+ * trim_heap - If block is a free block at the very end of its heap and bigger than
+ *             trim_threshold, shrink it to the arena's chunk size and give the rest
+ *             back to memlib. Called with the arena's lock held.
+ */
+static void trim_heap(arena_t *arena, block_t *block)
+{
+    size_t size = get_size(block);
+
+    if (get_size(find_next(block)) != 0 || size <= trim_threshold) { //not last in the heap, or not worth it
+      return;
+    }
+
+    remove_block(arena, block);                           //the block moves to a smaller size class
+
+    write_header(block, arena->chunk, 0, get_prev_alloc(block));
+    write_footer(block, arena->chunk, 0);
+    write_header(find_next(block), 0, 1, 0);              //new epilogue header at the new end of the heap
+
+    insert_block(arena, block);
+
+    mem_arena_trim(arena->id, size - arena->chunk);
+    arena->trims++;
+}
+
+/*
+ * map_block - Map a region of its own for a block of asize bytes.
+ *             Returns the block, or NULL if the mapping failed.
+ */
+static block_t *map_block(size_t asize)
+{
+    if (asize > SIZE_MAX - wsize - mem_pagesize()) { //the region size would wrap around
+      return NULL;
+    }
+
+    size_t size = round_up(asize + wsize, mem_pagesize()); //one pad word keeps the payload 16-byte aligned
+    unsigned char *region = mem_map(size);
+
+    if (region == NULL) {
+      return NULL;
+    }
+
+    block_t *block = (block_t *) (region + wsize);
+    store_header(block, pack(size, true, true) | mapped_mask);
+
+    return block;
+}
+
+/*
+ * unmap_block - Give the region of a mapped block back to the OS.
+ */
+static void unmap_block(block_t *block)
+{
+    mem_unmap((unsigned char *) block - wsize, get_size(block));
+}
+
+/*
+ * shrink_mapped_block - Give back the whole pages a mapped block no longer
+ *                       needs once it only has to hold asize bytes. The
+ *                       block keeps its address; if the mapping can't be
+ *                       shrunk it keeps its size too.
+ */
+static void shrink_mapped_block(block_t *block, size_t asize)
+{
+    size_t old_size = get_size(block);
+    size_t size = round_up(asize + wsize, mem_pagesize());
+
+    if (size < old_size && mem_remap((unsigned char *) block - wsize, old_size, size) == 0) {
+      store_header(block, pack(size, true, true) | mapped_mask);
+    }
+}
+
+/*
+ * get_thread_arena - Returns the arena this thread allocates from, assigning
+ *                    one round-robin on the thread's first allocation.
+ */
+static arena_t *get_thread_arena(void)
+{
+    if (thread_arena == NULL) {
+      thread_arena = &arenas[next_arena++ % MEM_ARENAS];
+    }
+
+    return thread_arena;
+}
+
+/*
+ * block_arena - Returns the arena a block belongs to, found from its address.
+ */
+static arena_t *block_arena(block_t *block)
+{
+    return &arenas[mem_arena_of(block)];
+}
 
 /*
- * mm_init - Initialize the memory manager
+ * tcache_get - Take a cached block of exactly asize bytes from this thread's
+ *              cache, or return NULL if there is none.
  */
-int mm_init(void)
+static block_t *tcache_get(size_t asize)
 {
-    /* Create the initial empty heap */
-    word_t *start = (word_t *)(mem_sbrk(2*wsize));
-    if ((ssize_t)start == -1) {
-        printf("ERROR: mem_sbrk failed in mm_init, returning %p\n", start);
-        return -1;
-    }
-
-    /* Prologue footer */
-    start[0] = pack(0, true);
-    /* Epilogue header */
-    start[1] = pack(0, true);
+    size_t bin = (asize - min_block_size) / dsize;
 
-    /* Heap starts with first "block header", currently the epilogue header */
-    heap_start = (block_t *) &(start[1]);
+    if (bin >= TCACHE_BINS) {                      //too big to be cached
+      return NULL;
+    }
 
-    /* Extend the empty heap with a free block of chunksize bytes */
-    block_t *free_block = extend_heap(chunksize);
-    if (free_block == NULL) {
-        printf("ERROR: extend_heap failed in mm_init, returning");
-        return -1;
+    if (tcache.generation != heap_generation) {    //an arena was reset: bring the cache up to date, which empties it
+      tcache_flush();
+      return NULL;
     }
 
-    /* Set the head of the free list to this new free block */
-    free_list_head = free_block;
-    free_list_head->payload.links.prev = NULL;
-    free_list_head->payload.links.next = NULL;
+    if (tcache.counts[bin] == 0) {
+      return NULL;
+    }
 
-    return 0;
+    return tcache.bins[bin][--tcache.counts[bin]]; //pop the most recently cached block
 }
 
 /*
- * mm_malloc - Allocate a block with at least size bytes of payload
+ * tcache_put - Keep an allocated block in this thread's cache instead of freeing it.
+ *              Returns false if the block is too big or its bin is full.
  */
-void *mm_malloc(size_t size)
+static bool tcache_put(block_t *block, size_t size)
 {
-    size_t asize;      // Allocated block size
-    size_t extendsize; // Size to be used to extend the heap
-    block_t *block;
+    size_t bin = (size - min_block_size) / dsize;
 
-    if (size == 0) // Ignore spurious request
-        return NULL;
+    if (bin >= TCACHE_BINS) {                      //too big to be cached
+      return false;
+    }
 
-    // Too small block
-    if (size <= dsize) {
-        asize = min_block_size;
-    } else {
-        // Round up and adjust to meet alignment requirements
-        asize = round_up(size + dsize, dsize);
+    if (tcache.generation != heap_generation) {    //an arena was reset: bring the cache up to date first
+      tcache_flush();
     }
 
-    block = find_fit(asize);   //find's first possible fit in the heap for block to be allocated
+    if (tcache.counts[bin] >= TCACHE_COUNT) {      //bin is full
+      return false;
+    }
 
-    if(block == NULL) {                   //if there was no fit for the block
-      extendsize = max(chunksize, asize); //sets size to extend heap by
-      extend_heap(extendsize);            //extend the heap and search for the first possible fit for the block
-      block = find_fit(asize);
+    if (!tcache.registered) {                      //first block cached by this thread
+      tcache_register();
     }
 
-    size_t newSize = get_size(block);
+    tcache.bins[bin][tcache.counts[bin]++] = block; //push onto the bin, the block stays marked allocated
 
-    remove_block(block); //remove the newly allocated block from the free list
+    return true;
+}
 
-    write_header(block, newSize, 1);  //write new header and footer for allocated block
-    write_footer(block, newSize, 1);
+/*
+ * tcache_destroy - pthread key destructor: empties the cache of the exiting thread
+ */
+static void tcache_destroy(void *cache)
+{
+    (void) cache;   //always this thread's tcache
+    tcache_flush();
+}
 
-    split_block(block, asize); //split the block (if possible)
- 
-    return header_to_payload(block);
+/*
+ * tcache_create_key - Create tcache_key, once per process
+ */
+static void tcache_create_key(void)
+{
+    pthread_key_create(&tcache_key, tcache_destroy);
 }
 
+/*
+ * tcache_register - Arrange for this thread's cache to be flushed when the thread exits.
+ */
+static void tcache_register(void)
+{
+    pthread_once(&tcache_once, tcache_create_key);
+    pthread_setspecific(tcache_key, &tcache);   //any non-NULL value makes the destructor run
+    tcache.registered = true;
+}
 
 /*
- * mm_free - Free a block
+ * tcache_flush - Free every block in this thread's cache back to its arena, a batch
+ *                per arena as in mm_free_batch, and empty the cache. Blocks from an
+ *                arena reset since they were cached no longer exist and are only
+ *                dropped; which arena a block is in comes from its address, so their
+ *                memory is never read. Leaves the cache at the current generation.
  */
-void mm_free(void *bp)
+static void tcache_flush(void)
 {
-    if (bp == NULL)
-        return;
+    block_t *pending[FREE_BATCH_MAX];
+    size_t count = 0;
+    arena_t *arena = NULL;
+    unsigned long generation = heap_generation;   //read first: resets advance it last
+    bool stale[MEM_ARENAS];
 
-    block_t *block = payload_to_header(bp); //gets pointer to block from the payload
+    for (int i = 0; i < MEM_ARENAS; i++) {
+      unsigned long current = arena_generation[i];
 
-    size_t size = get_size(block);
+      stale[i] = tcache.arena_generation[i] != current;
+      tcache.arena_generation[i] = current;
+    }
 
-    write_header(block, size, 0);          //write new header and footer for the block (0, as it is now free)
-    write_footer(block, size, 0);
+    for (size_t bin = 0; bin < TCACHE_BINS; bin++) {
+      for (size_t i = 0; i < tcache.counts[bin]; i++) {
+        block_t *block = tcache.bins[bin][i];
+
+        if (stale[mem_arena_of(block)]) {
+          continue;
+        }
+
+        if (count == FREE_BATCH_MAX || (count > 0 && block_arena(block) != arena)) {
+          free_blocks(arena, pending, count);
+          count = 0;
+        }
+
+        arena = block_arena(block);
+        pending[count++] = block;
+      }
+      tcache.counts[bin] = 0;
+    }
+
+    if (count > 0) {
+      free_blocks(arena, pending, count);
+    }
 
-    coalesce_block(block);                 //coalesce, if possible, with adjacent blocks
+    tcache.generation = generation;
 }
 
 /*
- * insert_block - Insert block at the head of the free list (e.g., LIFO policy)
+ * insert_block - Insert block at the head of the free list of its size class (e.g., LIFO policy)
  */
-static void insert_block(block_t *free_block)
+static void insert_block(arena_t *arena, block_t *free_block)
 {
-    if(free_list_head == NULL) {                      //edge case: if the free list is empty,  set this free block to the head
-      free_list_head = free_block;
-      free_list_head->payload.links.prev = NULL;
-      free_list_head->payload.links.next = NULL;
+    size_t class = find_class(get_size(free_block)); //the list this block belongs on
+
+    arena->free_count[class]++;
+
+    if(arena->seg_list[class] == NULL) {                     //edge case: if the free list is empty,  set this free block to the head
+      arena->seg_list[class] = free_block;
+      arena->seg_list[class]->payload.links.prev = NULL;
+      arena->seg_list[class]->payload.links.next = NULL;
       return;
     }
 
     free_block->payload.links.prev = NULL;            //set the block's previous = to NULL, as it is at the head of the free list
-    free_block->payload.links.next = free_list_head;  //set the block's next = to the current head
-    free_list_head->payload.links.prev = free_block;  //set the current head's previous block to the block that is about to be inserted
-    free_list_head = free_block;                      //set new block to the head
+    free_block->payload.links.next = arena->seg_list[class]; //set the block's next = to the current head
+    arena->seg_list[class]->payload.links.prev = free_block; //set the current head's previous block to the block that is about to be inserted
+    arena->seg_list[class] = free_block;                     //set new block to the head
 }
 
 /*
- * remove_block - Remove a free block from the free list
+ * remove_block - Remove a free block from the free list of its size class
  */
-static void remove_block(block_t *free_block)
+static void remove_block(arena_t *arena, block_t *free_block)
 {
+    size_t class = find_class(get_size(free_block)); //the list this block is on
     block_t *prev_block = free_block->payload.links.prev;
     block_t *next_block = free_block->payload.links.next;
 
-    if(free_list_head == NULL) {    //if the free list is empty -> there is nothing to remove
+    if(arena->seg_list[class] == NULL) {   //if the free list is empty -> there is nothing to remove
       return;
     }
 
+    arena->free_count[class]--;
+
+    if(arena->rover[class] == free_block) { //next fit resumes after the removed block
+      arena->rover[class] = next_block;
+    }
+
     if(prev_block == NULL && next_block == NULL) {      //if the block to be removed is the only block in the list
-      free_list_head = NULL;
+      arena->seg_list[class] = NULL;
     }
     else if(prev_block == NULL && next_block != NULL) { //if the block to be removed is the first in the list
-      free_list_head = next_block;                      //set the new head of the free list to the next block
-      free_list_head->payload.links.prev = NULL;
+      arena->seg_list[class] = next_block;                     //set the new head of the free list to the next block
+      arena->seg_list[class]->payload.links.prev = NULL;
     }
     else if(next_block == NULL && prev_block != NULL) { //if the block to be removed is the last in the list
       (prev_block)->payload.links.next = NULL;          //set the second to last block's next field to NULL -> this is the new last block
@@ -324,70 +1131,196 @@ static void remove_block(block_t *free_block)
 }
 
 /*
- * Finds a free block that of size at least asize
+ * Finds a free block that of size at least asize, starting at the smallest
+ * size class that can hold asize. Blocks in the starting class may still be too
+ * small, so that list is searched with the configured fit policy; any block in
+ * a larger class fits.
  */
-static block_t *find_fit(size_t asize)
+static block_t *find_fit(arena_t *arena, size_t asize)
+{
+    block_t *ptr;
+    size_t class = find_class(asize);
+    size_t probes = 0; //blocks examined, for the probe length histogram
+
+    switch (config.fit_policy) { //search the starting class
+    case MM_NEXT_FIT:
+        ptr = next_fit(arena, class, asize, &probes);
+        break;
+    case MM_BEST_FIT:
+        ptr = best_fit(arena, class, asize, &probes);
+        break;
+    default:
+        ptr = first_fit(arena, class, asize, &probes);
+        break;
+    }
+
+    for(class++; ptr == NULL && class < MM_NUM_CLASSES; class++) { //every block in a larger class is big enough
+        ptr = arena->seg_list[class];
+    }
+
+    if(ptr != NULL) {
+      probes++;
+    }
+    record_probes(arena, probes);
+
+    return ptr; // NULL if no fit found
+}
+
+/*
+ * first_fit - Returns the first block in a class that is at least asize bytes.
+ */
+static block_t *first_fit(arena_t *arena, size_t class, size_t asize, size_t *probes)
 {
     block_t *ptr;
 
-    for(ptr = free_list_head; ptr != NULL; ptr = ptr->payload.links.next) { //loop through the free list
+    for(ptr = arena->seg_list[class]; ptr != NULL; ptr = ptr->payload.links.next) { //loop through the class
         if(get_size(ptr) >= asize) { //if the block is at least the requested size (asize)
           return ptr;
         }
+        (*probes)++;
+    }
+
+    return NULL;
+}
+
+/*
+ * next_fit - Like first_fit, but starts at the class's roving pointer and wraps
+ *            around to the head of the list. The rover is left on the block found.
+ */
+static block_t *next_fit(arena_t *arena, size_t class, size_t asize, size_t *probes)
+{
+    block_t *start = arena->rover[class];
+    block_t *ptr;
+
+    for(ptr = start; ptr != NULL; ptr = ptr->payload.links.next) { //from the rover to the end of the list
+        if(get_size(ptr) >= asize) {
+          arena->rover[class] = ptr;
+          return ptr;
+        }
+        (*probes)++;
+    }
+
+    for(ptr = arena->seg_list[class]; ptr != start; ptr = ptr->payload.links.next) { //then from the head up to the rover
+        if(get_size(ptr) >= asize) {
+          arena->rover[class] = ptr;
+          return ptr;
+        }
+        (*probes)++;
+    }
+
+    return NULL;
+}
+
+/*
+ * best_fit - Returns the smallest of the first config.best_fit_n blocks in a
+ *            class that are at least asize bytes, stopping early on an exact fit.
+ */
+static block_t *best_fit(arena_t *arena, size_t class, size_t asize, size_t *probes)
+{
+    block_t *best = NULL;
+    size_t found = 0;
+
+    for(block_t *ptr = arena->seg_list[class]; ptr != NULL && found < config.best_fit_n; ptr = ptr->payload.links.next) {
+        size_t size = get_size(ptr);
+        (*probes)++;
+
+        if(size >= asize) {
+          if(best == NULL || size < get_size(best)) {
+            best = ptr;
+          }
+          if(size == asize) { //can't do better than an exact fit
+            break;
+          }
+          found++;
+        }
+    }
+
+    if(best != NULL) {
+      (*probes)--; //find_fit counts the block it returns
+    }
+
+    return best;
+}
+
+/*
+ * record_probes - Adds one find_fit search that examined probes blocks to the
+ *                 arena's histogram. Bucket 0 counts searches that examined no
+ *                 blocks, and bucket i > 0 those that examined 2^(i-1) up to
+ *                 2^i - 1 blocks; the last bucket takes everything longer.
+ */
+static void record_probes(arena_t *arena, size_t probes)
+{
+    size_t bucket = 0;
+
+    while (probes != 0 && bucket < MM_PROBE_BUCKETS - 1) {
+      bucket++;
+      probes >>= 1;
     }
 
-    return NULL; // no fit found
+    arena->probes[bucket]++;
 }
 
 /*
  * Coalesces current block with previous and next blocks if either or both are unallocated; otherwise the block is not modified.
  * Returns pointer to the coalesced block. After coalescing, the immediate contiguous previous and next blocks must be allocated.
+ * The previous block's footer is only read when the header says that block is free, so allocated blocks need no footer.
+ * The headers of blocks merged into another are zeroed.
  */
-static block_t *coalesce_block(block_t *block)
+static block_t *coalesce_block(arena_t *arena, block_t *block)
 {
     size_t size = get_size(block);
 
-    bool prev_alloc = extract_alloc(*find_prev_footer(block));  //set boolean values to check if the previous block and next block are allocated or not
+    bool prev_alloc = get_prev_alloc(block);  //set boolean values to check if the previous block and next block are allocated or not
     bool next_alloc = get_alloc(find_next(block));
 
-    block_t *prev_block = find_prev(block);
+    block_t *prev_block = prev_alloc ? NULL : find_prev(block);
     block_t *next_block = find_next(block);
 
+    if(!prev_alloc || !next_alloc) {   //at least one neighbour gets merged in
+      arena->coalesces++;
+    }
+
     if(prev_alloc && !next_alloc) {    //if the prev block is allocated and next block is free
       size += get_size(next_block);    //size is equal to current block and next block
 
-      remove_block(next_block);        //remove the next free block from the free list
+      remove_block(arena, next_block); //remove the next free block from the free list
+      store_header(next_block, 0);     //no longer a block of its own
 
-      write_header(block, size, 0);    //write new header and footer of new free block (with updated size)
+      write_header(block, size, 0, 1); //write new header and footer of new free block (with updated size)
       write_footer(block, size, 0);
     }
     else if(!prev_alloc && next_alloc) { //if the prev block is free and next block is allocated
       size += get_size(prev_block);      //size is equal to current block and prev block
 
-      remove_block(prev_block);          //remove the prev free block from the free list
+      remove_block(arena, prev_block);   //remove the prev free block from the free list
 
-      write_header(prev_block, size, 0); //write new header and footer for the new free block (with updated size)
+      write_header(prev_block, size, 0, get_prev_alloc(prev_block)); //write new header and footer for the new free block (with updated size)
       write_footer(prev_block, size, 0);
+      store_header(block, 0);
 
       block = prev_block;
     }
     else if(!prev_alloc && !next_alloc) { //both the previous block and next block are free
       size += get_size(prev_block) + get_size(next_block); //size is equal to current block, prev block, and next block
 
-      remove_block(prev_block);           //remove both the next and prev free blocks from the free list
-      remove_block(next_block);
+      remove_block(arena, prev_block);    //remove both the next and prev free blocks from the free list
+      remove_block(arena, next_block);
+      store_header(next_block, 0);
 
-      write_header(prev_block, size, 0); //write new header and footer for the new free block (with updated size)
+      write_header(prev_block, size, 0, get_prev_alloc(prev_block)); //write new header and footer for the new free block (with updated size)
       write_footer(prev_block, size, 0);
+      store_header(block, 0);
 
       block = prev_block;
     }
     else { //both the previous block and next block are allocated
-      write_header(block, size, 0);
+      write_header(block, size, 0, 1);
       write_footer(block, size, 0);
     }
 
-    insert_block(block); //insert newly coalesced block into the free list
+    write_prev_alloc(find_next(block), 0); //the block after the coalesced block now follows a free block
+
+    insert_block(arena, block); //insert newly coalesced block into the free list
 
     return block;
 }
@@ -396,21 +1329,100 @@ static block_t *coalesce_block(block_t *block)
  * See if new block can be split one to satisfy allocation
  * and one to keep free
  */
-static void split_block(block_t *block, size_t asize)
+static void split_block(arena_t *arena, block_t *block, size_t asize)
 {
     size_t block_size = get_size(block);
 
     if((block_size - asize) >= min_block_size) {       //if the block can be split
-      write_header(block, asize, 1);                   //write header and footer for allocated block
-      write_footer(block, asize, 1);
+      write_header(block, asize, 1, get_prev_alloc(block)); //write header (and footer) for allocated block
+      if(!elide_footers) {
+        write_footer(block, asize, 1);
+      }
 
       block_t *block_next = find_next(block);          //get pointer to next block - this will be the free part of the split block
 
-      write_header(block_next, block_size - asize, 0); //write new header and footer for new free block
+      write_header(block_next, block_size - asize, 0, 1); //write new header and footer for new free block
       write_footer(block_next, block_size - asize, 0);
 
-      coalesce_block(block_next);  //coalesce new free block (if possible)
+      arena->splits++;
+      coalesce_block(arena, block_next);  //coalesce new free block (if possible)
+    }
+}
+
+/*
+ * carve_blocks - Allocate n blocks of asize bytes back to back from the start of a
+ *                free block of at least n * asize bytes, storing their payloads in out.
+ *                What is left over becomes a new free block, or is absorbed by the
+ *                last block if it is too small to be one.
+ */
+static void carve_blocks(arena_t *arena, block_t *block, size_t asize, size_t n, void **out)
+{
+    size_t block_size = get_size(block);
+    size_t rest = block_size - n * asize;
+    bool prev_alloc = get_prev_alloc(block);
+
+    remove_block(arena, block);
+
+    for (size_t i = 0; i < n; i++) {
+      size_t size = (i == n - 1 && rest < min_block_size) ? asize + rest : asize;
+
+      write_header(block, size, 1, prev_alloc);
+      if(!elide_footers) {
+        write_footer(block, size, 1);
+      }
+      out[i] = header_to_payload(block);
+
+      prev_alloc = 1;
+      block = find_next(block);
+    }
+
+    arena->splits += n - 1;
+
+    if (rest >= min_block_size) {         //block is now just past the last carved block
+      write_header(block, rest, 0, 1);
+      write_footer(block, rest, 0);
+      arena->splits++;
+      coalesce_block(arena, block);
+      arena->in_use += block_size - rest;
+    } else {
+      write_prev_alloc(block, 1);         //the block after the old free block now follows an allocated block
+      arena->in_use += block_size;
+    }
+}
+
+/*
+ * free_blocks - Free n allocated blocks of one arena under a single lock. Each
+ *               block is marked free and coalesced before the next is touched,
+ *               exactly as mm_free would, so blocks of the batch that lie next
+ *               to each other end up as one free block. The end of the heap is
+ *               trimmed once at the end.
+ */
+static void free_blocks(arena_t *arena, block_t **blocks, size_t n)
+{
+    block_t *last = NULL; //coalesced block at the end of the heap, if any
+
+    pthread_mutex_lock(&arena->lock);
+
+    for (size_t i = 0; i < n; i++) {
+      block_t *block = blocks[i];
+      size_t size = get_size(block);
+
+      arena->in_use -= size;
+
+      write_header(block, size, 0, get_prev_alloc(block));
+      write_footer(block, size, 0);
+      block = coalesce_block(arena, block);
+
+      if (get_size(find_next(block)) == 0) { //a later block may still merge into this one, and then replaces it
+        last = block;
+      }
+    }
+
+    if (last != NULL) {
+      trim_heap(arena, last);
     }
+
+    pthread_mutex_unlock(&arena->lock);
 }
 
 
@@ -419,13 +1431,13 @@ static void split_block(block_t *block, size_t asize)
  * Returns a pointer to the result of coalescing the newly-created block with previous free block,
  * if applicable, or NULL in failure.
  */
-static block_t *extend_heap(size_t size)
+static block_t *extend_heap(arena_t *arena, size_t size)
 {
     void *bp;
 
     // Allocate an even number of words to maintain alignment
     size = round_up(size, dsize);
-    if ((bp = mem_sbrk(size)) == (void *)-1) {
+    if ((bp = mem_arena_sbrk(arena->id, size)) == (void *)-1) {
         return NULL;
     }
 
@@ -433,39 +1445,80 @@ static block_t *extend_heap(size_t size)
 
     block_t * block_start = payload_to_header(bp); //gets pointer to start of block using the pointer to the payload
 
-    write_header(block_start, size, 0);                   //writes header for the new free block
+    write_header(block_start, size, 0, get_prev_alloc(block_start)); //writes header for the new free block over the old epilogue
     write_footer(block_start, size, 0);                   //writes footer for the new free block
-    write_header(find_next(block_start), 0, 1);           //writes epilogue header
+    write_header(find_next(block_start), 0, 1, 0);        //writes epilogue header
+
+    arena->extends++;
+    update_peak_heap();
+
+    return coalesce_block(arena, block_start);
+}
+
+/*
+ * grow_heap - Extends the heap by at least size bytes, or the arena's current
+ *             chunk size if that is larger, and then adapts the chunk size for the
+ *             next extension if adaptive_chunks is set. Returns the new free block,
+ *             or NULL in failure.
+ */
+static block_t *grow_heap(arena_t *arena, size_t size)
+{
+    block_t *block = extend_heap(arena, max(arena->chunk, size));
+
+    if (block != NULL && config.adaptive_chunks) {
+      if (2 * arena->in_use >= mem_arena_heapsize(arena->id)) { //heap is well used: grow faster next time
+        arena->chunk = (2 * arena->chunk > max_chunksize) ? max_chunksize : 2 * arena->chunk;
+      } else {                                                  //heap is mostly free: back off
+        arena->chunk = max(arena->chunk / 2, chunksize);
+      }
+    }
+
+    return block;
+}
+
+/*
+ * update_peak_heap - Raises peak_heap to the current heap size if that is larger.
+ *                    Arenas grow concurrently, so this retries until it wins.
+ */
+static void update_peak_heap(void)
+{
+    size_t heap = mem_heapsize();
+    size_t peak = peak_heap;
 
-    return coalesce_block(block_start);
+    while (heap > peak && !atomic_compare_exchange_weak(&peak_heap, &peak, heap)) {
+      continue; //peak now holds the value another thread stored
+    }
 }
 
 /******** The remaining content below are helper and debug routines ********/
 
 /*
- * Return whether the pointer is in the heap.
+ * Return whether the pointer is in the arena's heap.
  * May be useful for debugging.
  */
-static int in_heap(const void* p)
+static int in_heap(arena_t *arena, const void* p)
 {
-    return p <= mem_heap_hi() && p >= mem_heap_lo();
+    return p <= mem_arena_hi(arena->id) && p >= mem_arena_lo(arena->id);
 }
 
 /*
- * examine_heap -- Print the heap by iterating through it as an implicit free list.
+ * examine_heap -- Print an arena's heap by iterating through it as an implicit free list.
  */
-static void examine_heap() {
+static void examine_heap(arena_t *arena) {
   block_t *block;
 
   /* print to stderr so output isn't buffered and not output if we crash */
-  fprintf(stderr, "free_list_head: %p\n", (void *)free_list_head);
+  fprintf(stderr, "arena %d\n", arena->id);
+  for (size_t i = 0; i < MM_NUM_CLASSES; i++) {
+    fprintf(stderr, "seg_list[%zu]: %p\n", i, (void *)arena->seg_list[i]);
+  }
 
-  for (block = heap_start; /* first block on heap */
-      get_size(block) > 0 && block < (block_t*)mem_heap_hi();
+  for (block = arena->heap_start; /* first block on heap */
+      get_size(block) > 0 && block < (block_t*)mem_arena_hi(arena->id);
       block = find_next(block)) {
 
     /* print out common block attributes */
-    fprintf(stderr, "%p: %ld %d\t", (void *)block, get_size(block), get_alloc(block));
+    fprintf(stderr, "%p: %ld %d %d\t", (void *)block, get_size(block), get_alloc(block), get_prev_alloc(block));
 
     /* and allocated/free specific data */
     if (get_alloc(block)) {
@@ -480,29 +1533,29 @@ static void examine_heap() {
 }
 
 
-/* check_heap: checks the heap for correctness; returns true if
+/* check_heap: checks an arena's heap for correctness; returns true if
  *               the heap is correct, and false otherwise.
  */
-static bool check_heap()
+static bool check_heap(arena_t *arena)
 {
     // Implement a heap consistency checker as needed.
 
     /* Below is an example, but you will need to write the heap checker yourself. */
 
-    if (!heap_start) {
+    if (!arena->heap_start) {
         printf("NULL heap list pointer!\n");
         return false;
     }
 
-    block_t *curr = heap_start;
+    block_t *curr = arena->heap_start;
     block_t *next;
-    block_t *hi = mem_heap_hi();
+    block_t *hi = mem_arena_hi(arena->id);
 
     while ((next = find_next(curr)) + 1 < hi) {
-        word_t hdr = curr->header;
+        word_t hdr = load_header(curr) & ~prev_alloc_mask;
         word_t ftr = *find_prev_footer(next);
 
-        if (hdr != ftr) {
+        if ((!get_alloc(curr) || !elide_footers) && hdr != ftr) {
             printf(
                     "Header (0x%016lX) != footer (0x%016lX)\n",
                     hdr, ftr
@@ -510,9 +1563,22 @@ static bool check_heap()
             return false;
         }
 
+        //did two free blocks escape coalescing?
+        if (!get_alloc(curr) && get_size(next) != 0 && !get_alloc(next)) {
+          printf("%s\n", "adjacent free blocks!");
+          examine_heap(arena);
+          return false;
+        }
+
+        //does the next block know whether this one is allocated?
+        if (get_prev_alloc(next) != get_alloc(curr)) {
+          printf("%s\n", "prev alloc bit does not match previous block!");
+          return false;
+        }
+
         //is every block in the bounds of the heap?
         void *bp = header_to_payload(curr);
-        if(!in_heap(bp)) {
+        if(!in_heap(arena, bp)) {
           printf("%s\n", "block is not in the heap!");
           return false;
         }
@@ -520,12 +1586,19 @@ static bool check_heap()
         curr = next;
     }
 
-    //is every block in the free list marked as free?
-    for(curr = free_list_head; curr != NULL; curr = curr->payload.links.next) {
-      if(get_alloc(curr) == 1) {//a free block is allocated
-        printf("%s\n", "free block is not marked as free!");
-        examine_heap();
-        return false;
+    //is every block in the free lists marked as free and in the right size class?
+    for(size_t i = 0; i < MM_NUM_CLASSES; i++) {
+      for(curr = arena->seg_list[i]; curr != NULL; curr = curr->payload.links.next) {
+        if(get_alloc(curr) == 1) {//a free block is allocated
+          printf("%s\n", "free block is not marked as free!");
+          examine_heap(arena);
+          return false;
+        }
+        if(find_class(get_size(curr)) != i) {//a free block is on the wrong list
+          printf("%s\n", "free block is in the wrong size class!");
+          examine_heap(arena);
+          return false;
+        }
       }
     }
 
@@ -534,6 +1607,33 @@ static bool check_heap()
 }
 
 
+/*
+ * mm_checkheap - Check the heap of every arena that has been set up, each
+ *                under its lock. Returns 1 if all of them are consistent.
+ *                Blocks sitting in thread caches count as allocated.
+ */
+int mm_checkheap(void)
+{
+    for (int i = 0; i < MEM_ARENAS; i++) {
+      arena_t *arena = &arenas[i];
+      bool ok = true;
+
+      pthread_mutex_lock(&arena->lock);
+      if (arena->heap_start != NULL) {
+        ok = check_heap(arena);
+      }
+      pthread_mutex_unlock(&arena->lock);
+
+      if (!ok) {
+        printf("arena %d failed the heap check\n", i);
+        return 0;
+      }
+    }
+
+    return 1;
+}
+
+
 /*
  *****************************************************************************
  * The functions below are short wrapper functions to perform                *
@@ -549,6 +1649,57 @@ static size_t max(size_t x, size_t y)
     return (x > y) ? x : y;
 }
 
+/*
+ * min: returns x if x < y, and y otherwise.
+ */
+static size_t min(size_t x, size_t y)
+{
+    return (x < y) ? x : y;
+}
+
+
+/*
+ * find_class: returns the index of the segregated free list that holds
+ *             blocks of the given size.
+ */
+static size_t find_class(size_t size)
+{
+    size_t class = 0;
+    size_t limit = min_block_size;
+
+    while (class < MM_NUM_CLASSES - 1 && size > limit) {
+        class++;
+        limit <<= 1;
+    }
+
+    return class;
+}
+
+
+/*
+ * adjust_size: returns the block size needed to hold size bytes of payload,
+ *              including overhead and alignment, or 0 if size is so large
+ *              that the block size would not fit in a size_t.
+ */
+static size_t adjust_size(size_t size)
+{
+    // Header, plus footer unless allocated blocks elide it
+    size_t overhead = elide_footers ? wsize : dsize;
+
+    // Too big: adding the overhead and rounding up would wrap around
+    if (size > SIZE_MAX - dsize - overhead) {
+        return 0;
+    }
+
+    // Too small block
+    if (size + overhead <= min_block_size) {
+        return min_block_size;
+    }
+
+    // Round up and adjust to meet alignment requirements
+    return round_up(size + overhead, dsize);
+}
+
 
 /*
  * round_up: Rounds size up to next multiple of n
@@ -562,10 +1713,42 @@ static size_t round_up(size_t size, size_t n)
 /*
  * pack: returns a header reflecting a specified size and its alloc status.
  *       If the block is allocated, the lowest bit is set to 1, and 0 otherwise.
+ *       If the previous block is allocated, the second lowest bit is set.
+ */
+static word_t pack(size_t size, bool alloc, bool prev_alloc)
+{
+    word_t word = size;
+
+    if (alloc) {
+        word |= alloc_mask;
+    }
+    if (prev_alloc) {
+        word |= prev_alloc_mask;
+    }
+
+    return word;
+}
+
+
+/*
+ * load_header: returns the header word of a block. A relaxed load is a plain
+ *              load on common hardware; other threads only ever change the
+ *              prev alloc bit of a block they don't own, so the size and alloc
+ *              bits read are always current.
+ */
+static word_t load_header(block_t *block)
+{
+    return atomic_load_explicit(&block->header, memory_order_relaxed);
+}
+
+
+/*
+ * store_header: sets the header word of a block. Called with the lock of the
+ *               block's arena held, except for blocks no other thread can see.
  */
-static word_t pack(size_t size, bool alloc)
+static void store_header(block_t *block, word_t word)
 {
-    return alloc ? (size | alloc_mask) : size;
+    atomic_store_explicit(&block->header, word, memory_order_relaxed);
 }
 
 
@@ -585,7 +1768,7 @@ static size_t extract_size(word_t word)
  */
 static size_t get_size(block_t *block)
 {
-    return extract_size(block->header);
+    return extract_size(load_header(block));
 }
 
 
@@ -605,17 +1788,50 @@ static bool extract_alloc(word_t word)
  */
 static bool get_alloc(block_t *block)
 {
-    return extract_alloc(block->header);
+    return extract_alloc(load_header(block));
+}
+
+
+/*
+ * get_prev_alloc: returns true when the block before this one in the heap
+ *                 is allocated, based on the second lowest header bit.
+ */
+static bool get_prev_alloc(block_t *block)
+{
+    return (bool) (load_header(block) & prev_alloc_mask);
+}
+
+
+/*
+ * get_mapped: returns true when the block was mapped on its own rather than
+ *             being part of a heap.
+ */
+static bool get_mapped(block_t *block)
+{
+    return (bool) (load_header(block) & mapped_mask);
+}
+
+
+/*
+ * payload_size: returns the number of payload bytes an allocated block can hold.
+ */
+static size_t payload_size(block_t *block)
+{
+    if (get_mapped(block)) {      //pad word and header
+        return get_size(block) - dsize;
+    }
+
+    return get_size(block) - (elide_footers ? wsize : dsize);
 }
 
 
 /*
- * write_header: given a block and its size and allocation status,
- *               writes an appropriate value to the block header.
+ * write_header: given a block and its size and allocation status (and that of
+ *               the previous block), writes an appropriate value to the block header.
  */
-static void write_header(block_t *block, size_t size, bool alloc)
+static void write_header(block_t *block, size_t size, bool alloc, bool prev_alloc)
 {
-    block->header = pack(size, alloc);
+    store_header(block, pack(size, alloc, prev_alloc));
 }
 
 
@@ -627,7 +1843,19 @@ static void write_header(block_t *block, size_t size, bool alloc)
 static void write_footer(block_t *block, size_t size, bool alloc)
 {
     word_t *footerp = header_to_footer(block);
-    *footerp = pack(size, alloc);
+    *footerp = pack(size, alloc, false);
+}
+
+
+/*
+ * write_prev_alloc: updates only the previous-block allocation bit in the
+ *                   header of block, leaving its size and alloc bit alone.
+ */
+static void write_prev_alloc(block_t *block, bool prev_alloc)
+{
+    word_t header = load_header(block);
+
+    store_header(block, prev_alloc ? (header | prev_alloc_mask) : (header & ~prev_alloc_mask));
 }
 
 
@@ -647,14 +1875,15 @@ static block_t *find_next(block_t *block)
 static word_t *find_prev_footer(block_t *block)
 {
     // Compute previous footer position as one word before the header
-    return &(block->header) - 1;
+    return (word_t *) &(block->header) - 1;
 }
 
 
 /*
  * find_prev: returns the previous block position by checking the previous
  *            block's footer and calculating the start of the previous block
- *            based on its size.
+ *            based on its size. Only valid if the previous block is free
+ *            (or footers are not elided).
  */
 static block_t *find_prev(block_t *block)
 {
@@ -4,6 +4,60 @@ extern int mm_init(void);
 extern void *mm_malloc(size_t size);
 extern void mm_free(void *ptr);
 
+// Allocate n blocks of at least size bytes into out[] under one lock; returns how many were allocated
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+
+// mm_free for a block allocated (or last reallocated) with size bytes; small blocks skip the header read
+extern void mm_free_sized(void *ptr, size_t size);
+
+// Free n blocks (NULL entries are skipped), taking each arena's lock once per batch
+extern void mm_free_batch(void **ptrs, size_t n);
+
 // Extra credit
 extern void* mm_realloc(void* ptr, size_t size);
 
+// Discard every block in one arena (0 <= arena < MEM_ARENAS) and start it over
+extern void mm_arena_reset(int arena);
+
+/* Policies for searching a size class for a free block */
+typedef enum {
+    MM_FIRST_FIT,  // first block that fits
+    MM_NEXT_FIT,   // first block that fits, resuming where the last search stopped
+    MM_BEST_FIT    // smallest of the first best_fit_n blocks that fit
+} mm_fit_policy_t;
+
+/* Options for mm_init_config */
+typedef struct {
+    mm_fit_policy_t fit_policy;
+    size_t best_fit_n;    // blocks examined by MM_BEST_FIT (at least 1)
+    int adaptive_chunks;  // nonzero: grow heap extensions geometrically, backing off when utilization drops
+} mm_config_t;
+
+// mm_init with explicit options; mm_init() uses first fit and fixed chunks
+extern int mm_init_config(const mm_config_t *config);
+
+// Number of segregated free list size classes
+#define MM_NUM_CLASSES 14
+
+// Number of buckets in the find_fit probe length histogram
+#define MM_PROBE_BUCKETS 8
+
+/* Allocator statistics, as reported by mm_stats */
+typedef struct {
+    size_t bytes_in_use;                      // bytes in allocated blocks, including mapped ones
+    size_t heap_size;                         // mem_heapsize() now
+    size_t peak_heap_size;                    // largest mem_heapsize() since mm_init
+    size_t mapped_bytes;                      // bytes in blocks mapped outside the heap
+    size_t free_blocks[MM_NUM_CLASSES];       // free list length of each size class
+    unsigned long splits;                     // blocks split to satisfy a request
+    unsigned long coalesces;                  // frees that merged with a free neighbour
+    unsigned long extend_heap_calls;          // times the heap was extended
+    unsigned long trims;                      // times the heap was shrunk
+    unsigned long probe_hist[MM_PROBE_BUCKETS]; // find_fit searches examining 0, 1, 2-3, 4-7, ... blocks
+} mm_stats_t;
+
+// Check the heap of every arena in use; returns 0 if one is inconsistent, printing what is wrong
+extern int mm_checkheap(void);
+
+// Fill in stats with counters summed over all arenas; cheap enough to call in production
+extern void mm_stats(mm_stats_t *stats);
@@ -0,0 +1,273 @@
+/*
+ * mm_batch_test.c - Checks that batched frees leave the heap fully coalesced.
+ *
+ * Each case allocates enough blocks to grow the heap well past
+ * trim_threshold, frees some of them one at a time so that free blocks sit
+ * between the rest, and then frees the rest in batches, in address order
+ * and shuffled. Two more cases free small blocks one at a time from a
+ * thread of their own, so that many of them end up in its cache, which is
+ * then flushed in batches when an arena is reset and when the thread exits.
+ * Afterwards every arena in use must pass mm_checkheap (which
+ * rejects two free blocks next to each other), hold no allocated bytes and
+ * be down to a single free block that trim_heap has cut back to one chunk.
+ * Prints what failed and exits nonzero if anything did.
+ *
+ * Build (memlib.c needs config.h from the lab handout):
+ *
+ *   gcc -O2 -pthread -o mm_batch_test mm_batch_test.c mm.c memlib.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+#define NUM_BLOCKS 4000       // blocks allocated by each case
+#define TRIMMED_HEAP 8192     // an arena cut back to one chunk is smaller than this
+
+static void *blocks[NUM_BLOCKS];
+static int failures = 0;
+
+/*
+ * rnd - xorshift random numbers, so every run does the same thing
+ */
+static unsigned rnd(void)
+{
+    static uint64_t state = 0x9E3779B97F4A7C15ull;
+
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (unsigned) state;
+}
+
+/*
+ * shuffle - Put the first n entries of p in random order
+ */
+static void shuffle(void **p, size_t n)
+{
+    for (size_t i = n; i > 1; i--) {
+        size_t j = rnd() % i;
+        void *tmp = p[i - 1];
+
+        p[i - 1] = p[j];
+        p[j] = tmp;
+    }
+}
+
+/*
+ * allocate_all - Fill blocks with NUM_BLOCKS allocations of sizes between
+ *                min_size and max_size, all from this thread's arena
+ */
+static void allocate_all(size_t min_size, size_t max_size)
+{
+    for (size_t i = 0; i < NUM_BLOCKS; i++) {
+        blocks[i] = mm_malloc(min_size + rnd() % (max_size - min_size + 1));
+        if (blocks[i] == NULL) {
+            printf("mm_malloc failed\n");
+            exit(1);
+        }
+        memset(blocks[i], 0x5A, min_size);
+    }
+}
+
+/*
+ * check_empty - Every arena in use must be consistent, hold nothing and be
+ *               one trimmed free block
+ */
+static void check_empty(const char *name)
+{
+    mm_stats_t stats;
+    size_t arenas = 0;
+    size_t free_blocks = 0;
+    int ok = mm_checkheap();
+
+    mm_stats(&stats);
+
+    for (int i = 0; i < MEM_ARENAS; i++) {
+        size_t size = mem_arena_heapsize(i);
+
+        if (size == 0) {
+            continue;
+        }
+        arenas++;
+        if (size >= TRIMMED_HEAP) {
+            printf("%s: arena %d is still %zu bytes\n", name, i, size);
+            ok = 0;
+        }
+    }
+
+    for (size_t i = 0; i < MM_NUM_CLASSES; i++) {
+        free_blocks += stats.free_blocks[i];
+    }
+
+    if (stats.bytes_in_use != 0) {
+        printf("%s: %zu bytes still in use\n", name, stats.bytes_in_use);
+        ok = 0;
+    }
+    if (free_blocks != arenas) {
+        printf("%s: %zu free blocks in %zu arenas\n", name, free_blocks, arenas);
+        ok = 0;
+    }
+    if (stats.trims == 0) {
+        printf("%s: the heap was never trimmed\n", name);
+        ok = 0;
+    }
+
+    printf("%-28s %s\n", name, ok ? "ok" : "FAILED");
+    failures += !ok;
+}
+
+/*
+ * start - Start a case with an empty heap
+ */
+static void start(void)
+{
+    mem_reset_brk();
+    if (mm_init() != 0) {
+        printf("mm_init failed\n");
+        exit(1);
+    }
+}
+
+/*
+ * batch_free_every_third - Free every third block singly, then the rest in
+ *                          one batch in address order, so each pair freed
+ *                          together is followed by a block that was free
+ *                          already. Sizes stay above the thread cache.
+ */
+static void batch_free_every_third(void)
+{
+    void *rest[NUM_BLOCKS];
+    size_t n = 0;
+
+    start();
+    allocate_all(600, 2000);
+
+    for (size_t i = 0; i < NUM_BLOCKS; i++) {
+        if (i % 3 == 2) {
+            mm_free(blocks[i]);
+        } else {
+            rest[n++] = blocks[i];
+        }
+    }
+    mm_free_batch(rest, n);
+
+    check_empty("batch after every third");
+}
+
+/*
+ * batch_free_shuffled - Free the blocks in batches of random order and
+ *                       length
+ */
+static void batch_free_shuffled(void)
+{
+    start();
+    allocate_all(600, 2000);
+    shuffle(blocks, NUM_BLOCKS);
+
+    for (size_t i = 0; i < NUM_BLOCKS; ) {
+        size_t n = 1 + rnd() % 200;
+
+        if (n > NUM_BLOCKS - i) {
+            n = NUM_BLOCKS - i;
+        }
+        mm_free_batch(blocks + i, n);
+        i += n;
+    }
+
+    check_empty("shuffled batches");
+}
+
+/*
+ * cache_then_exit - Thread: free small blocks from the end of the heap down,
+ *                   so the first of them fill the thread cache with
+ *                   neighbours and keep the heap from being trimmed until
+ *                   the exit flush frees them
+ */
+static void *cache_then_exit(void *arg)
+{
+    (void) arg;
+
+    allocate_all(16, 500);
+    for (size_t i = NUM_BLOCKS; i > 0; i--) {
+        mm_free(blocks[i - 1]);
+    }
+
+    return NULL;
+}
+
+/*
+ * cache_then_reset - Thread: as cache_then_exit, but keep one block and then
+ *                    reset an unused arena, so freeing that block flushes the
+ *                    cache for the new generation first. The arena must be
+ *                    consistent after that flush; the exit flush then frees
+ *                    the kept block.
+ */
+static void *cache_then_reset(void *arg)
+{
+    int *ok = arg;
+    void *keep;
+    int unused = 0;
+
+    allocate_all(16, 500);
+    keep = mm_malloc(100);
+
+    for (size_t i = NUM_BLOCKS; i > 0; i--) {
+        mm_free(blocks[i - 1]);
+    }
+
+    while (mem_arena_heapsize(unused) != 0) {
+        unused++;
+    }
+    mm_arena_reset(unused);
+    mm_free(keep);
+
+    *ok = mm_checkheap();
+    return NULL;
+}
+
+/*
+ * cache_flush - Run a thread that frees through its cache and check the
+ *               heap once it has exited
+ */
+static void cache_flush(void *(*thread)(void *), const char *name)
+{
+    pthread_t tid;
+    int ok = 1;
+
+    start();
+    pthread_create(&tid, NULL, thread, &ok);
+    pthread_join(tid, NULL);
+
+    if (!ok) {
+        printf("%s: heap check failed before the thread exited\n", name);
+        failures++;
+    }
+    check_empty(name);
+}
+
+/*
+ * main - Main routine
+ */
+int main(void)
+{
+    mem_init();
+
+    batch_free_every_third();
+    batch_free_shuffled();
+    cache_flush(cache_then_exit, "cache flushed at exit");
+    cache_flush(cache_then_reset, "cache flushed on reset");
+
+    mem_deinit();
+
+    if (failures != 0) {
+        printf("%d cases failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,437 @@
+/*
+ * mmbench.c - Replays malloc lab trace files against mm.c (and optionally
+ *             libc malloc) and reports throughput, peak heap utilization
+ *             and per-operation latency percentiles.
+ *
+ * Traces use the malloc lab format: an optional header of plain numbers
+ * (suggested heap size, number of ids, number of ops, weight), followed by
+ * one request per line:
+ *
+ *   a <id> <bytes>    allocate <bytes> and call the block <id>
+ *   r <id> <bytes>    reallocate block <id> to <bytes>
+ *   f <id>            free block <id>
+ *
+ * Every trace is replayed twice with each allocator: once untimed per
+ * operation to measure throughput, and once timing every call for the
+ * latency percentiles. Throughput counts only the trace's own requests:
+ * the allocator's init is not timed, and freeing whatever blocks the trace
+ * leaves allocated is reported on its own as teardown. The second pass also samples mm's footprint
+ * (mem_heapsize() plus blocks mapped outside the heap) after every call;
+ * utilization is the peak of live requested bytes over the peak footprint.
+ *
+ * Build (memlib.c needs config.h from the lab handout):
+ *
+ *   gcc -O2 -pthread -o mmbench mmbench.c mm.c memlib.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+/* Type of one trace request */
+typedef enum { OP_ALLOC, OP_REALLOC, OP_FREE, NUM_OPS } op_type_t;
+
+static const char *op_names[NUM_OPS] = { "malloc", "realloc", "free" };
+
+/* One request from a trace file */
+typedef struct {
+    op_type_t type;
+    size_t id;
+    size_t size;
+} trace_op_t;
+
+/* A whole trace file */
+typedef struct {
+    char *name;
+    trace_op_t *ops;
+    size_t num_ops;
+    size_t num_ids;   // largest id + 1
+} trace_t;
+
+/* An allocator under test */
+typedef struct {
+    const char *name;
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    int uses_memlib;  // footprint can be read from mem_heapsize and mem_mapsize
+} allocator_t;
+
+/* Results of replaying one trace with one allocator */
+typedef struct {
+    double secs;                 // untimed replay of the trace's requests, wall clock
+    double teardown_secs;        // freeing what the trace left allocated, wall clock
+    size_t peak_payload;         // largest number of live requested bytes
+    size_t peak_heap;            // peak mem_heapsize() + mem_mapsize(), if uses_memlib
+    uint64_t *lat[NUM_OPS];      // per-call latency in ns, by op type
+    size_t num_lat[NUM_OPS];
+} result_t;
+
+/* Globals set by command line args */
+static int verbosity = 0;
+static mm_config_t config = { MM_FIRST_FIT, 8, 0 };
+
+/*
+ * mm_bench_init - mm_init_config with the options from the command line,
+ *                 on a freshly reset memlib heap
+ */
+static int mm_bench_init(void)
+{
+    mem_reset_brk();
+    return mm_init_config(&config);
+}
+
+/*
+ * libc_init - libc malloc needs no setup
+ */
+static int libc_init(void)
+{
+    return 0;
+}
+
+static const allocator_t mm_allocator = { "mm", mm_bench_init, mm_malloc, mm_free, mm_realloc, 1 };
+static const allocator_t libc_allocator = { "libc", libc_init, malloc, free, realloc, 0 };
+
+/*
+ * now_ns - monotonic clock in nanoseconds
+ */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/*
+ * read_trace - Parse a trace file. Exits on a malformed file.
+ */
+static void read_trace(const char *fn, trace_t *trace)
+{
+    FILE *fp = fopen(fn, "r");
+    char line[256];
+    size_t cap = 1024;
+
+    if (fp == NULL) {
+        fprintf(stderr, "Error opening trace %s\n", fn);
+        exit(1);
+    }
+
+    trace->name = strdup(fn);
+    trace->ops = malloc(cap * sizeof(trace_op_t));
+    trace->num_ops = 0;
+    trace->num_ids = 0;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        trace_op_t op;
+        char type;
+        int fields = sscanf(line, " %c %zu %zu", &type, &op.id, &op.size);
+
+        if (fields < 2 || (type != 'a' && type != 'r' && type != 'f')) { //header numbers or blank lines
+            continue;
+        }
+        if (type != 'f' && fields < 3) {
+            fprintf(stderr, "%s: bad request: %s", fn, line);
+            exit(1);
+        }
+
+        op.type = (type == 'a') ? OP_ALLOC : (type == 'r') ? OP_REALLOC : OP_FREE;
+
+        if (trace->num_ops == cap) {
+            cap *= 2;
+            trace->ops = realloc(trace->ops, cap * sizeof(trace_op_t));
+        }
+        trace->ops[trace->num_ops++] = op;
+
+        if (op.id + 1 > trace->num_ids) {
+            trace->num_ids = op.id + 1;
+        }
+    }
+
+    fclose(fp);
+}
+
+/*
+ * replay - Run every request of a trace against an allocator, then free
+ *          every block still allocated. The requests are timed as a whole,
+ *          after the allocator's init, in res->secs and the final frees in
+ *          res->teardown_secs. If lat is set, each call is timed and
+ *          recorded in res as well. Returns 0 on success, -1 if the
+ *          allocator failed a request.
+ */
+static int replay(const trace_t *trace, const allocator_t *alloc, result_t *res, int lat)
+{
+    void **blocks = calloc(trace->num_ids, sizeof(void *));
+    size_t *sizes = calloc(trace->num_ids, sizeof(size_t));
+    size_t live = 0;
+    uint64_t start = 0;
+    uint64_t begin;
+
+    if (alloc->init() != 0) {
+        fprintf(stderr, "%s: init failed\n", alloc->name);
+        free(blocks);
+        free(sizes);
+        return -1;
+    }
+
+    res->peak_payload = 0;
+    res->peak_heap = 0;
+    begin = now_ns();
+
+    for (size_t i = 0; i < trace->num_ops; i++) {
+        const trace_op_t *op = &trace->ops[i];
+        void *p = NULL;
+
+        if (lat) {
+            start = now_ns();
+        }
+
+        switch (op->type) {
+        case OP_ALLOC:
+            p = alloc->malloc(op->size);
+            break;
+        case OP_REALLOC:
+            p = alloc->realloc(blocks[op->id], op->size);
+            break;
+        case OP_FREE:
+            alloc->free(blocks[op->id]);
+            break;
+        default:
+            break;
+        }
+
+        if (lat) {
+            res->lat[op->type][res->num_lat[op->type]++] = now_ns() - start;
+        }
+
+        if (op->type != OP_FREE && p == NULL && op->size != 0) {
+            fprintf(stderr, "%s: %s of %zu bytes failed at op %zu of %s\n",
+                    alloc->name, op_names[op->type], op->size, i, trace->name);
+            free(blocks);
+            free(sizes);
+            return -1;
+        }
+
+        live -= sizes[op->id];
+        blocks[op->id] = (op->type == OP_FREE) ? NULL : p;
+        sizes[op->id] = (op->type == OP_FREE) ? 0 : op->size;
+        live += sizes[op->id];
+
+        if (live > res->peak_payload) {
+            res->peak_payload = live;
+        }
+        if (lat && alloc->uses_memlib && mem_heapsize() + mem_mapsize() > res->peak_heap) {
+            res->peak_heap = mem_heapsize() + mem_mapsize();
+        }
+    }
+
+    res->secs = (double) (now_ns() - begin) / 1e9;
+
+    begin = now_ns();
+    for (size_t id = 0; id < trace->num_ids; id++) { //the next replay starts from an empty heap
+        alloc->free(blocks[id]);
+    }
+    res->teardown_secs = (double) (now_ns() - begin) / 1e9;
+
+    free(blocks);
+    free(sizes);
+    return 0;
+}
+
+/*
+ * cmp_u64 - qsort comparator for latencies
+ */
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * percentile - the p-th percentile of n sorted latencies
+ */
+static uint64_t percentile(const uint64_t *lat, size_t n, double p)
+{
+    size_t i = (size_t) (p / 100.0 * (double) (n - 1) + 0.5);
+
+    return lat[i];
+}
+
+/*
+ * free_latencies - Free the latency arrays of a result
+ */
+static void free_latencies(result_t *res)
+{
+    for (int t = 0; t < NUM_OPS; t++) {
+        free(res->lat[t]);
+    }
+}
+
+/*
+ * run_trace - Benchmark one allocator on one trace and print the results.
+ *             Returns -1 if the allocator failed.
+ */
+static int run_trace(const trace_t *trace, const allocator_t *alloc)
+{
+    result_t res;
+    size_t counts[NUM_OPS] = { 0 };
+
+    memset(&res, 0, sizeof(res));
+    for (size_t i = 0; i < trace->num_ops; i++) {
+        counts[trace->ops[i].type]++;
+    }
+    for (int t = 0; t < NUM_OPS; t++) {
+        res.lat[t] = malloc((counts[t] + 1) * sizeof(uint64_t));
+    }
+
+    /* Throughput pass */
+    if (replay(trace, alloc, &res, 0) != 0) {
+        free_latencies(&res);
+        return -1;
+    }
+
+    if (verbosity && alloc->uses_memlib) {
+        mm_stats_t stats;
+
+        mm_stats(&stats);
+        printf("  stats: splits %lu coalesces %lu extends %lu trims %lu probes",
+               stats.splits, stats.coalesces, stats.extend_heap_calls, stats.trims);
+        for (int b = 0; b < MM_PROBE_BUCKETS; b++) {
+            printf(" %lu", stats.probe_hist[b]);
+        }
+        printf("\n");
+    }
+
+    /* Latency pass */
+    result_t lat_res = res;
+    if (replay(trace, alloc, &lat_res, 1) != 0) {
+        free_latencies(&res);
+        return -1;
+    }
+
+    printf("%-24s %-5s %10.0f ops/s", trace->name, alloc->name,
+           (double) trace->num_ops / (res.secs > 0 ? res.secs : 1e-9));
+    if (alloc->uses_memlib && lat_res.peak_heap > 0) {
+        printf("  util %5.1f%%", 100.0 * (double) lat_res.peak_payload / (double) lat_res.peak_heap);
+    } else {
+        printf("  util    n/a");
+    }
+    printf("  teardown %.3f ms\n", res.teardown_secs * 1e3);
+
+    for (int t = 0; t < NUM_OPS; t++) {
+        size_t n = lat_res.num_lat[t];
+
+        if (n == 0) {
+            continue;
+        }
+        qsort(lat_res.lat[t], n, sizeof(uint64_t), cmp_u64);
+        printf("  %-8s n=%-9zu p50 %6llu ns  p90 %6llu ns  p99 %6llu ns  max %8llu ns\n",
+               op_names[t], n,
+               (unsigned long long) percentile(lat_res.lat[t], n, 50),
+               (unsigned long long) percentile(lat_res.lat[t], n, 90),
+               (unsigned long long) percentile(lat_res.lat[t], n, 99),
+               (unsigned long long) lat_res.lat[t][n - 1]);
+    }
+
+    free_latencies(&res);
+    return 0;
+}
+
+/*
+ * printUsage - Print usage info
+ */
+static void printUsage(char *argv[])
+{
+    printf("Usage: %s [-hlav] [-p <policy>] [-n <num>] <trace>...\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h           Print this help message.\n");
+    printf("  -l           Also run every trace against libc malloc.\n");
+    printf("  -a           Use adaptive chunk growth in mm.\n");
+    printf("  -p <policy>  mm fit policy: first, next or best.\n");
+    printf("  -n <num>     Blocks examined by the best fit policy.\n");
+    printf("  -v           Print mm_stats after each trace.\n");
+    printf("\nExample:\n");
+    printf("  linux>  %s -l -p best traces/*.rep\n", argv[0]);
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char *argv[])
+{
+    int use_libc = 0;
+    int status = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "hlavp:n:")) != -1) {
+        switch (c) {
+        case 'l':
+            use_libc = 1;
+            break;
+        case 'a':
+            config.adaptive_chunks = 1;
+            break;
+        case 'p':
+            if (strcmp(optarg, "first") == 0) {
+                config.fit_policy = MM_FIRST_FIT;
+            } else if (strcmp(optarg, "next") == 0) {
+                config.fit_policy = MM_NEXT_FIT;
+            } else if (strcmp(optarg, "best") == 0) {
+                config.fit_policy = MM_BEST_FIT;
+            } else {
+                printUsage(argv);
+                exit(1);
+            }
+            break;
+        case 'n':
+            config.best_fit_n = (size_t) atol(optarg);
+            break;
+        case 'v':
+            verbosity = 1;
+            break;
+        case 'h':
+            printUsage(argv);
+            exit(0);
+        default:
+            printUsage(argv);
+            exit(1);
+        }
+    }
+
+    if (optind == argc) {
+        printf("%s: Missing trace file\n", argv[0]);
+        printUsage(argv);
+        exit(1);
+    }
+
+    mem_init();
+
+    for (int i = optind; i < argc; i++) {
+        trace_t trace;
+
+        read_trace(argv[i], &trace);
+
+        if (run_trace(&trace, &mm_allocator) != 0) {
+            status = 1;
+        }
+        if (use_libc && run_trace(&trace, &libc_allocator) != 0) {
+            status = 1;
+        }
+
+        free(trace.ops);
+        free(trace.name);
+    }
+
+    mem_deinit();
+    return status;
+}